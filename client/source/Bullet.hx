@@ -14,13 +14,15 @@ class Bullet extends FlxSprite
 	public var tail_thickness:Int = 2;
 	public var range:Float;
 	public var impact_dist:Float = -1;
+	// in pixels/sec, hitscan bullets cross their range in hit_scan_bullet_lifetime
+	public var speed:Float = -1;
 
 	var init_pos_x:Float = 0;
 	var init_pos_y:Float = 0;
 
 	public var tail:FlxSprite;
 
-	override public function new(owner:Int, x:Float, y:Float, angle:Float, damage:Float = 0, range:Float = 500)
+	override public function new(owner:Int, x:Float, y:Float, angle:Float, damage:Float = 0, range:Float = 500, speed:Float = -1)
 	{
 		super();
 		this.radius = 1;
@@ -32,6 +34,7 @@ class Bullet extends FlxSprite
 		this.shoot_angle = angle;
 		this.damage = damage;
 		this.range = range;
+		this.speed = speed;
 		this.solid = true;
 		this.visible = true;
 		this.immovable = true;
@@ -74,6 +77,11 @@ class Bullet extends FlxSprite
 			kill();
 	}
 
+	public function distFromStart(x:Float, y:Float)
+	{
+		return Math.sqrt((x - init_pos_x) * (x - init_pos_x) + (y - init_pos_y) * (y - init_pos_y));
+	}
+
 	public function setImpactDist(dist:Float)
 	{
 		impact_dist = dist;
@@ -87,7 +95,7 @@ class Bullet extends FlxSprite
 
 	public function shoot()
 	{
-		var speed = range / Config.hit_scan_bullet_lifetime;
+		var speed = this.speed > 0 ? this.speed : range / Config.hit_scan_bullet_lifetime;
 		this.velocity.x = Math.cos(shoot_angle) * speed;
 		this.velocity.y = Math.sin(shoot_angle) * speed;
 	}
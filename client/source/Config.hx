@@ -4,6 +4,8 @@ import flixel.util.FlxColor;
 class Config
 {
 	public static var ACK_SIZE:Int = 2;
+	// earlier controls repeated in each control frame, in case theirs was lost
+	public static var MAX_REDUNDANT_CONTROLS:Int = 8;
 	public static var CLIENT_RATE:Int = 60;
 	public static var SERVER_RATE:Int = 20;
 
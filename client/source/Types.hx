@@ -51,14 +51,34 @@ typedef EntityDesc =
 	random_state:haxe.io.Bytes,
 }
 
+// spawn (type 0) or impact (type 1) of a bullet with a travel time, the
+// server simulates them and only tells where they start and stop
+typedef ProjectileEvent =
+{
+	type:Int,
+	id:Int,
+	// owner for a spawn, entity hit for an impact (-1 for walls)
+	entity:Int,
+	x:Float,
+	y:Float,
+	// spawn only, speed in pixels/sec
+	angle:Float,
+	speed:Float,
+}
+
 typedef Snapshot =
 {
 	id:Int,
 	server_tick:Int,
 	client_tick:Int,
+	// latest control received by the server, and which of the ones before it
+	// were received (bit k of the bytes for control_tick - k)
+	control_tick:Int,
+	control_ack:haxe.io.Bytes,
 	player:EntityDesc,
 	entities:haxe.ds.Vector<EntityDesc>,
 	despawned:haxe.ds.Vector<Int>,
+	projectile_events:haxe.ds.Vector<ProjectileEvent>,
 }
 
 typedef TileSet =
@@ -99,6 +119,8 @@ typedef ControlFrame =
 	last_snapshot:Int,
 	ack:haxe.io.Bytes,
 	control:Control,
+	// earlier controls not acknowledged yet, newest first
+	redundant:Array<{client_tick:Int, control:Control}>,
 }
 
 typedef NetworkFrame =
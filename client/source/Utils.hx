@@ -3,6 +3,7 @@ import Types.ControlFrame;
 import Types.EntityDesc;
 import Types.Movement;
 import Types.NetworkFrame;
+import Types.ProjectileEvent;
 import Types.Snapshot;
 import Types.Timed;
 import Types.Weapon;
@@ -279,6 +280,8 @@ class Utils
 		var id = reader.readInt32();
 		var server_tick = reader.readInt32();
 		var client_tick = reader.readInt32();
+		var control_tick = reader.readInt32();
+		var control_ack = reader.readBytes(Config.ACK_SIZE);
 
 		var player = readEntity(reader, true);
 
@@ -292,13 +295,43 @@ class Utils
 		for (i in 0...n_despawned)
 			despawned[i] = reader.readInt32();
 
+		var n_events = reader.readInt32();
+		var projectile_events = new haxe.ds.Vector<ProjectileEvent>(n_events);
+		for (i in 0...n_events)
+		{
+			var type = reader.readInt8();
+			var event_id = reader.readUInt16();
+			var entity = reader.readInt32();
+			var x = reader.readFloat();
+			var y = reader.readFloat();
+			var angle = 0.0;
+			var speed = 0.0;
+			if (type == 0)
+			{
+				angle = reader.readFloat();
+				speed = reader.readFloat();
+			}
+			projectile_events[i] = {
+				type: type,
+				id: event_id,
+				entity: entity,
+				x: x,
+				y: y,
+				angle: angle,
+				speed: speed,
+			};
+		}
+
 		var res = {
 			id: id,
 			server_tick: server_tick,
 			client_tick: client_tick,
+			control_tick: control_tick,
+			control_ack: control_ack,
 			player: player,
 			entities: entities,
 			despawned: despawned,
+			projectile_events: projectile_events,
 		};
 
 		return res;
@@ -526,12 +559,25 @@ class Utils
 	{
 		var control_bytes = bytesOfControl(frame.control);
 
-		var bytes = haxe.io.Bytes.alloc(8 + frame.ack.length + control_bytes.length);
+		// then the number of earlier controls, and for each its tick (offset back from client_tick) and itself
+		var bytes = haxe.io.Bytes.alloc(8 + frame.ack.length + control_bytes.length + 1 + frame.redundant.length * (1 + control_bytes.length));
 
 		bytes.setInt32(0, frame.client_tick);
 		bytes.setInt32(4, frame.last_snapshot);
 		bytes.blit(8, frame.ack, 0, frame.ack.length);
-		bytes.blit(8 + frame.ack.length, control_bytes, 0, control_bytes.length);
+		var pos = 8 + frame.ack.length;
+		bytes.blit(pos, control_bytes, 0, control_bytes.length);
+		pos += control_bytes.length;
+
+		bytes.set(pos, frame.redundant.length);
+		pos += 1;
+		for (earlier in frame.redundant)
+		{
+			var earlier_bytes = bytesOfControl(earlier.control);
+			bytes.set(pos, frame.client_tick - earlier.client_tick);
+			bytes.blit(pos + 1, earlier_bytes, 0, earlier_bytes.length);
+			pos += 1 + earlier_bytes.length;
+		}
 
 		return bytes;
 	}
@@ -16,6 +16,16 @@ class Weapons
 		return null;
 	}
 
+	// farthest a bullet can go, whatever its weapon
+	public static function maxRange()
+	{
+		var res = 0;
+		for (weap in weapons)
+			if (weap.range > res)
+				res = weap.range;
+		return res;
+	}
+
 	public static function toString()
 	{
 		var name_list = [];
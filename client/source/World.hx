@@ -4,6 +4,7 @@ import Player.GhostedPlayer;
 import Types.Control;
 import Types.ControlFrame;
 import Types.EntityDesc;
+import Types.ProjectileEvent;
 import Types.Snapshot;
 import Types.TileMap;
 import Types.TileSet;
@@ -45,6 +46,8 @@ class World extends FlxGroup
 	var entities:FlxGroup;
 	var entities_bullets:BulletGroup;
 	var entities_bullet_tails:FlxTypedGroup<FlxSprite>;
+	// bullets with a travel time simulated by the server, by projectile id
+	var projectiles:Map<Int, Bullet> = new Map();
 	var entities_hud:HUD;
 
 	var tilemap:TileMap;
@@ -156,18 +159,20 @@ class World extends FlxGroup
 
 			if (frame.control.shoot && player.canShoot(frame.client_tick))
 			{
-				for (i in 0...player.equipped_weapon.bullet_count)
-				{
-					var random_noise = player.random_generator.uniform(-player.equipped_weapon.spread / 180 * Math.PI / 2,
-						player.equipped_weapon.spread / 180 * Math.PI / 2);
-					var bullet = new Bullet(player.ID, player.x + player.radius, player.y + player.radius, player.facing_angle + random_noise,
-						player.equipped_weapon.damage, player.equipped_weapon.range);
-					entities_bullets.add(bullet);
-					entities_bullet_tails.add(bullet.tail);
-					var dist = doHitScan(frame.client_tick, bullet);
-					if (dist > 0)
-						bullet.setImpactDist(dist);
-				}
+				// projectiles are drawn from the events of the server
+				if (player.equipped_weapon.bullet_speed <= 0)
+					for (i in 0...player.equipped_weapon.bullet_count)
+					{
+						var random_noise = player.random_generator.uniform(-player.equipped_weapon.spread / 180 * Math.PI / 2,
+							player.equipped_weapon.spread / 180 * Math.PI / 2);
+						var bullet = new Bullet(player.ID, player.x + player.radius, player.y + player.radius, player.facing_angle + random_noise,
+							player.equipped_weapon.damage, player.equipped_weapon.range);
+						entities_bullets.add(bullet);
+						entities_bullet_tails.add(bullet.tail);
+						var dist = doHitScan(frame.client_tick, bullet);
+						if (dist > 0)
+							bullet.setImpactDist(dist);
+					}
 				player.registerShoot(frame.client_tick);
 			}
 		}
@@ -233,6 +238,31 @@ class World extends FlxGroup
 		}
 	}
 
+	function handleProjectileEvent(event:ProjectileEvent)
+	{
+		if (event.type == 0)
+		{
+			var bullet = new Bullet(event.entity, event.x, event.y, event.angle, 0, Weapons.maxRange(), event.speed);
+			entities_bullets.add(bullet);
+			entities_bullet_tails.add(bullet.tail);
+			projectiles.set(event.id, bullet);
+		}
+		else
+		{
+			// the spawn may have been in a lost snapshot
+			var bullet = projectiles.get(event.id);
+			if (bullet == null)
+				return;
+
+			var dist = bullet.distFromStart(event.x, event.y);
+			if (dist > 0)
+				bullet.setImpactDist(dist);
+			else
+				bullet.kill();
+			projectiles.remove(event.id);
+		}
+	}
+
 	public function spawnEntity(tick:Int, desc:EntityDesc)
 	{
 		switch (desc.type)
@@ -292,18 +322,45 @@ class World extends FlxGroup
 			}
 			despawnEntities(snapshot);
 
+			for (event in snapshot.projectile_events)
+				handleProjectileEvent(event);
+
 			while (frame_history.length > 0 && frame_history[0].client_tick <= snapshot.client_tick)
 				frame_history.shift();
 		}
 	}
 
+	// true if the server said it received the control of `tick`
+	function isControlAcked(snapshot:Snapshot, tick:Int)
+	{
+		var k = snapshot.control_tick - tick;
+		if (k < 0 || k >= Config.ACK_SIZE * 8)
+			return false;
+
+		return ((snapshot.control_ack.get(k >> 3) >> (k & 7)) & 1) == 1;
+	}
+
 	public function makeControlFrame()
 	{
+		var client_tick = Math.floor(Time.nowInClientTicks());
+
+		// the controls the server may not have yet go again with this one
+		var last_snap = snapshot_history.get(0);
+		var redundant = [];
+		var i = frame_history.length - 1;
+		while (i >= 0 && redundant.length < Config.MAX_REDUNDANT_CONTROLS && client_tick - frame_history[i].client_tick < 256)
+		{
+			if (frame_history[i].client_tick < client_tick && !isControlAcked(last_snap, frame_history[i].client_tick))
+				redundant.push({client_tick: frame_history[i].client_tick, control: frame_history[i].control});
+			i--;
+		}
+
 		var frame = {
-			client_tick: Math.floor(Time.nowInClientTicks()),
+			client_tick: client_tick,
 			last_snapshot: snapshot_history.get(0).id,
 			ack: snapshot_history.makeAck(),
 			control: player.getControl(),
+			redundant: redundant,
 		};
 		frame_history.push(frame);
 
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// bit scans on 64 bits words, `x` must not be 0
+
+inline int countTrailingZeros64(uint64_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+inline int countLeadingZeros64(uint64_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanReverse64(&i, x);
+    return 63 - (int)i;
+#else
+    return __builtin_clzll(x);
+#endif
+}
+
+// index of the highest set bit
+inline int highestBit64(uint64_t x)
+{
+    return 63 - countLeadingZeros64(x);
+}
+
+// bit i goes to bit 63 - i
+inline uint64_t reverseBits64(uint64_t x)
+{
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+#if defined(_MSC_VER)
+    return _byteswap_uint64(x);
+#else
+    return __builtin_bswap64(x);
+#endif
+}
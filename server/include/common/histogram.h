@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifndef HISTOGRAM_SUB_BITS
+#define HISTOGRAM_SUB_BITS 4
+#endif
+
+// HDR-style histogram of positive integer values (eg. durations in ns).
+// Values are bucketed by magnitude (highest set bit) with HISTOGRAM_SUB_BITS
+// bits of precision below it, so the relative error stays under
+// 1 / 2^HISTOGRAM_SUB_BITS for any value and recording is a couple of
+// instructions, no allocation.
+class Histogram
+{
+    static const int SUB_BUCKETS = 1 << HISTOGRAM_SUB_BITS;
+    static const int N_BUCKETS = (64 - HISTOGRAM_SUB_BITS + 1) * SUB_BUCKETS;
+
+    uint64_t counts[N_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t min_value;
+    uint64_t max_value;
+
+    static int bucketOf(uint64_t value);
+    static uint64_t highestOf(int bucket);
+
+public:
+    Histogram();
+
+    void record(uint64_t value);
+    void merge(const Histogram &other);
+    void reset();
+
+    uint64_t count() const { return total; }
+    uint64_t minValue() const { return total > 0 ? min_value : 0; }
+    uint64_t maxValue() const { return max_value; }
+    double mean() const;
+
+    // highest value of the bucket containing the p-th percentile (p in [0, 100])
+    uint64_t percentile(double p) const;
+};
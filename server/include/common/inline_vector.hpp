@@ -0,0 +1,37 @@
+#pragma once
+
+// Vector with a fixed capacity and its elements stored inline, so that it can
+// live on the stack (or in an object) and be filled without allocating.
+// Elements are trivially copied, meant for pointers and small structs.
+template <typename T, int N>
+class InlineVector
+{
+    T content[N];
+    int len = 0;
+
+public:
+    // false when full, the element is dropped
+    bool push_back(const T &elt)
+    {
+        if (len >= N)
+            return false;
+
+        content[len++] = elt;
+        return true;
+    }
+
+    void clear() { len = 0; }
+
+    int size() const { return len; }
+    bool empty() const { return len == 0; }
+    bool full() const { return len >= N; }
+    static constexpr int capacity() { return N; }
+
+    T &operator[](int i) { return content[i]; }
+    const T &operator[](int i) const { return content[i]; }
+
+    T *begin() { return content; }
+    T *end() { return content + len; }
+    const T *begin() const { return content; }
+    const T *end() const { return content + len; }
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define JOB_CHUNK_SIZE 64 // items taken at once by a thread
+
+// Worker threads running the same job over ranges of items. The calling
+// thread works too, so a pool with 0 workers just runs the job inline.
+// `run` returns once every item is done, jobs must only write to the slots
+// of their own items.
+class JobPool
+{
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned generation = 0; // bumped for each run
+    bool stopping = false;
+    int busy = 0; // workers still on the current run
+
+    const std::function<void(int, int)> *job = nullptr;
+    int n_items = 0;
+    std::atomic<int> next_item;
+
+    void work(unsigned seen); // `seen`: generation when the worker started
+    void runChunks();
+
+public:
+    JobPool(int n_workers = 0);
+    ~JobPool();
+
+    JobPool(const JobPool &) = delete;
+    JobPool &operator=(const JobPool &) = delete;
+
+    // stops the current workers and starts `n_workers` new ones, not while running
+    void resize(int n_workers);
+    int getNWorkers() const { return (int)workers.size(); }
+
+    // calls job(begin, end) on chunks of [0, n) until all are done
+    void run(int n, const std::function<void(int, int)> &job);
+};
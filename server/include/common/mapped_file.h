@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+
+// A whole file mapped in memory. The mapping is copy-on-write: pages can be
+// written to but the changes never reach the file.
+class MappedFile
+{
+    char *ptr;
+    size_t len;
+#ifdef _WIN32
+    void *file;
+    void *mapping;
+#endif
+
+public:
+    MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    ~MappedFile();
+
+    bool open(const char *path);
+    void close();
+
+    bool isOpen() const { return ptr != nullptr; }
+    char *data() const { return ptr; }
+    size_t size() const { return len; }
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "loguru/loguru.hpp"
+
+// Fixed capacity pool of preallocated objects.
+// All objects are default constructed once, when the pool is created. Objects
+// are not destroyed when released: the user is expected to reset them when
+// they are acquired again, so that acquire/release never allocate.
+template <typename T>
+class Pool
+{
+    int capacity;
+    T *objects = nullptr;
+    int *free_slots = nullptr; // stack of free indices
+    int n_free = 0;
+
+public:
+    Pool(int capacity);
+    ~Pool();
+
+    Pool(const Pool &) = delete;
+    Pool &operator=(const Pool &) = delete;
+
+    // returns nullptr when the pool is exhausted
+    T *acquire();
+    void release(T *object);
+
+    bool owns(const T *object) const;
+
+    int size() const { return capacity - n_free; }
+    int space() const { return n_free; }
+};
+
+template <typename T>
+Pool<T>::Pool(int capacity) : capacity(capacity)
+{
+    objects = new T[capacity];
+    free_slots = new int[capacity];
+
+    // hand out low indices first
+    for (int i = 0; i < capacity; i++)
+        free_slots[i] = capacity - 1 - i;
+    n_free = capacity;
+}
+
+template <typename T>
+Pool<T>::~Pool()
+{
+    delete[] objects;
+    delete[] free_slots;
+}
+
+template <typename T>
+T *Pool<T>::acquire()
+{
+    if (n_free <= 0)
+        return nullptr;
+
+    return &objects[free_slots[--n_free]];
+}
+
+template <typename T>
+void Pool<T>::release(T *object)
+{
+    if (!owns(object))
+    {
+        LOG_F(ERROR, "release: object does not belong to this pool (ignored)");
+        return;
+    }
+
+    free_slots[n_free++] = (int)(object - objects);
+}
+
+template <typename T>
+bool Pool<T>::owns(const T *object) const
+{
+    return object >= objects && object < objects + capacity;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#include "common/histogram.h"
+#include "common/time.h"
+#include "common/trace.h"
+
+// Summary of the durations of a phase, in ns.
+struct PhaseStats
+{
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t max;
+};
+
+// Durations of the named phases of a loop (numbered by the caller), one
+// histogram each. Recording takes an uncontended lock, so the thread running
+// the loop records while another one collects.
+class Profiler
+{
+    std::mutex mutex;
+    std::vector<Histogram> phases;
+    const char *const *names;
+
+public:
+    Profiler(const char *const *names, int n_phases);
+
+    int size() const { return (int)phases.size(); }
+    const char *getName(int phase) const { return names[phase]; }
+
+    void record(int phase, uint64_t ns);
+
+    // fills `stats[0, size())` with what was recorded since the last call
+    // and forgets it
+    void collect(PhaseStats *stats);
+};
+
+// Records the time from its construction to its destruction in a phase of
+// a profiler, two clock reads. It is also a trace zone named after the
+// phase while a capture is running, `arg` tells what it worked on.
+class ScopedTimer
+{
+    Profiler *profiler;
+    int phase;
+    int arg;
+    unsigned long long start;
+
+public:
+    ScopedTimer(Profiler &profiler, int phase, int arg = -1) : profiler(&profiler), phase(phase), arg(arg), start(Time::nowInNanoseconds()) {}
+    ~ScopedTimer() { stop(); }
+
+    // ends the phase before the end of the scope
+    void stop()
+    {
+        if (!profiler)
+            return;
+
+        unsigned long long end = Time::nowInNanoseconds();
+        profiler->record(phase, end - start);
+        if (Trace::isEnabled())
+            Trace::record(profiler->getName(phase), (int64_t)start, (int64_t)end, arg);
+        profiler = nullptr;
+    }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+};
+
+// one line per phase that ran: count and p50/p99/max in us
+void logPhases(const char *prefix, const char *const *names, const PhaseStats *stats, int n);
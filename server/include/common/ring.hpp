@@ -1,213 +1,168 @@
 #pragma once
 
-#include "loguru/loguru.hpp"
+#include <stdint.h>
+
+#include "common/bits.h"
 
 // reference https://code.haxe.org/category/data-structures/ring-array.html
 // reference https://github.com/torvalds/linux/blob/master/include/linux/circ_buf.h
 
-template <typename T>
+// Elements indexed by increasing ids, only the last N ids are kept: the ring
+// holds ids (head_id - N, head_id], some of them may be missing. Element `id`
+// is stored in slot `id & (N - 1)` and whether it is there is bit
+// `id & (N - 1)` of a single word, so looking for the next present element
+// and making an ack are a few bit operations.
+template <typename T, int N>
 class Ring
 {
-    int head = 0;
-    int tail = 0;
-    int len = 0;
-    int cap = 0;
-    int head_id = 0;
-    T *content = nullptr;
-    bool *present = nullptr;
+    static_assert(N >= 4 && N <= 64 && (N & (N - 1)) == 0, "Ring capacity must be a power of two, at most 64");
 
-    T *_get(int i);
-    void _set(int i, T v);
-    bool _present(int i);
+    static constexpr int MASK = N - 1;
+    static constexpr uint64_t ALL = N == 64 ? ~0ULL : (1ULL << (N & 63)) - 1;
 
-    void push(T elt);
-    void skip();
+    T content[N];
+    uint64_t present = 0; // bit i: slot i holds an element
+    int head_id = 0;
+    int len = 0; // ids of the window seen so far, from head_id - len + 1 to head_id
 
-public:
-    Ring(int len);
-    ~Ring();
+    // rotations within the N bits of a word
+    static uint64_t rotl(uint64_t x, int s) { return s == 0 ? x : ((x << s) | (x >> (N - s))) & ALL; }
+    static uint64_t rotr(uint64_t x, int s) { return s == 0 ? x : ((x >> s) | (x << (N - s))) & ALL; }
+    // `n` low bits set, 0 < n <= N
+    static uint64_t lowBits(int n) { return n >= 64 ? ~0ULL : (1ULL << n) - 1; }
 
-    void reset();
+public:
+    void clear(); // forget all elements
 
-    int size();
-    int space();
+    int size() const { return len; }
+    int space() const { return N - len; }
+    static constexpr int capacity() { return N; }
+    int getHeadId() const { return head_id; }
+    int getTailId() const { return head_id - len + 1; } // oldest id of the window
 
     T *getById(int id);
     T *get(int i); // i-th from last
 
-    bool mem(int id);
+    bool mem(int id) const;
+
+    // first id >= `from` that is present, -1 if none
+    int findNextPresent(int from) const;
+    // last id <= `from` that is present, -1 if none
+    int findPrevPresent(int from) const;
 
     void write(int id, T elt);
 
-    void makeAck(bool *ack);
+    // bit i set when element head_id - i is present (bit 0 is the most recent)
+    uint64_t makeAck() const;
 };
 
-template <typename T>
-Ring<T>::Ring(int length)
+template <typename T, int N>
+void Ring<T, N>::clear()
 {
-    if (length < 4)
-    {
-        len = 4;
-    }
-    else if ((length & (length - 1)) > 0)
-    {
-        len = length - 1;
-        len |= len >> 1;
-        len |= len >> 2;
-        len |= len >> 4;
-        len |= len >> 8;
-        len |= len >> 16;
-        len++;
-    }
-    else
-        len = length;
-
-    cap = len - 1;
-    content = (T *)malloc(len * sizeof(T));
-    present = (bool *)malloc(len * sizeof(bool));
-    for (int i = 0; i < len; i++)
-        present[i] = false;
+    present = 0;
+    head_id = 0;
+    len = 0;
 }
 
-template <typename T>
-Ring<T>::~Ring()
+template <typename T, int N>
+T *Ring<T, N>::getById(int id)
 {
-    free(content);
-}
-
-template <typename T>
-T *Ring<T>::_get(int i)
-{
-    if (i < 0 || i > cap)
-    {
-        LOG_F(ERROR, "_get: index %d out of bounds %d, %d", i, 0, cap);
+    if (!mem(id))
         return nullptr;
-    }
-
-    if (present[i])
-        return &content[i];
 
-    return nullptr;
+    return &content[id & MASK];
 }
 
-template <typename T>
-void Ring<T>::_set(int i, T v)
+template <typename T, int N>
+T *Ring<T, N>::get(int i)
 {
-    if (i < 0 || i > cap)
-    {
-        LOG_F(ERROR, "_set: index %d out of bounds %d, %d", i, 0, cap);
-        return;
-    }
-
-    content[i] = v;
-    present[i] = true;
+    return getById(head_id - i);
 }
 
-template <typename T>
-bool Ring<T>::_present(int i)
+template <typename T, int N>
+bool Ring<T, N>::mem(int id) const
 {
-    if (i < 0 || i > cap)
+    if (len <= 0 || id > head_id || id <= head_id - len)
         return false;
-    return present[i];
-}
-
-template <typename T>
-void Ring<T>::push(T v)
-{
-    if (space() == 0)
-        tail = (tail + 1) & cap;
 
-    content[head] = v;
-    present[head] = true;
-    head = (head + 1) & cap;
+    return (present >> (id & MASK)) & 1;
 }
 
-template <typename T>
-void Ring<T>::skip()
+template <typename T, int N>
+int Ring<T, N>::findNextPresent(int from) const
 {
-    if (space() == 0)
-        tail = (tail + 1) & cap;
+    int first = head_id - len + 1;
+    if (len <= 0 || from > head_id)
+        return -1;
+    if (from < first)
+        from = first;
 
-    present[head] = false;
-    head = (head + 1) & cap;
-}
+    // ids from `from` to head_id at the bottom of the word
+    uint64_t bits = rotr(present, from & MASK) & lowBits(head_id - from + 1);
+    if (bits == 0)
+        return -1;
 
-template <typename T>
-void Ring<T>::reset()
-{
-    head = 0;
-    tail = 0;
+    return from + countTrailingZeros64(bits);
 }
 
-template <typename T>
-int Ring<T>::size()
+template <typename T, int N>
+int Ring<T, N>::findPrevPresent(int from) const
 {
-    return (head - tail) & cap;
-}
-
-template <typename T>
-int Ring<T>::space()
-{
-    return (tail - head - 1) & cap;
-}
-
-template <typename T>
-T *Ring<T>::getById(int id)
-{
-    if (size() <= 0 || id > head_id || id <= head_id - cap)
-        return nullptr;
-
-    return _get((head - (head_id - id) - 1) & cap);
-}
-
-template <typename T>
-T *Ring<T>::get(int i)
-{
-    if (i > size())
-        return nullptr;
-
-    return _get((head - i - 1) & cap);
-}
+    int first = head_id - len + 1;
+    if (len <= 0 || from < first)
+        return -1;
+    if (from > head_id)
+        from = head_id;
 
-template <typename T>
-bool Ring<T>::mem(int id)
-{
-    if (size() <= 0 || id > head_id || id < head_id - cap)
-        return false;
+    // ids from `first` to `from` at the bottom of the word
+    uint64_t bits = rotr(present, first & MASK) & lowBits(from - first + 1);
+    if (bits == 0)
+        return -1;
 
-    return _present((head - (head_id - id) - 1) & cap);
+    return first + highestBit64(bits);
 }
 
-template <typename T>
-void Ring<T>::write(int id, T v)
+template <typename T, int N>
+void Ring<T, N>::write(int id, T v)
 {
-    if (size() == 0)
+    if (len == 0)
     {
-        push(v);
         head_id = id;
+        len = 1;
+        present = 0;
     }
-    else
+    else if (id > head_id)
     {
-        if (id > head_id)
-        {
-            for (int i = 0; i < id - head_id - 1; i++)
-                skip();
-            push(v);
-            head_id = id;
-        }
-        else if (id >= head_id - cap)
-        {
-            _set((head - (head_id - id) - 1) & cap, v);
-
-            if (head_id - id > size())
-                tail = (head - (head_id - id) - 1) & cap;
-        }
+        // the slots of the new ids are freed by the oldest ones
+        int d = id - head_id;
+        if (d >= N)
+            present = 0;
+        else
+            present &= ~rotl(lowBits(d), (head_id + 1) & MASK);
+
+        head_id = id;
+        len = len + d < N ? len + d : N;
     }
+    else if (id > head_id - N)
+    {
+        if (head_id - id >= len)
+            len = head_id - id + 1;
+    }
+    else
+        // too old
+        return;
+
+    content[id & MASK] = v;
+    present |= 1ULL << (id & MASK);
 }
 
-template <typename T>
-void Ring<T>::makeAck(bool *ack)
+template <typename T, int N>
+uint64_t Ring<T, N>::makeAck() const
 {
-    for (int i = 0; i <= cap; i++)
-        ack[i] = _present((head - i - 1) & cap);
-}
\ No newline at end of file
+    if (len <= 0)
+        return 0;
+
+    // head_id to the top bit of the N bits, then reversed to bit 0
+    uint64_t bits = rotl(present, MASK - (head_id & MASK)) & (lowBits(len) << (N - len));
+    return reverseBits64(bits) >> (64 - N);
+}
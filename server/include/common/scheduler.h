@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common/time.h"
+
+#ifndef SCHEDULER_SPIN_NS
+#define SCHEDULER_SPIN_NS 2000000 // spin instead of sleeping in the last 2ms before a tick
+#endif
+
+// Fixed timestep scheduler. Tick k starts k * period after Time::startNow,
+// so ticks line up with Time::nowInTicks and never drift.
+// `wait` sleeps until the next tick boundary (the OS sleep is too coarse to
+// hit it, so the end of the wait is spent spinning) and tells how many ticks
+// are due. Loops that block on something else (eg. a socket) ask poll
+// instead, and block for at most timeBeforeNextTick. When the caller is late,
+// at most `max_catch_up` ticks are run on one wakeup, the older ones are
+// dropped and counted.
+class TickScheduler
+{
+    unsigned long long period_ns;
+    int max_catch_up;
+
+    tick_t last_tick; // last tick handed to the caller
+    unsigned long long dropped = 0;
+    unsigned long long last_lateness = 0;
+
+    int takeDueTicks(unsigned long long now, tick_t *first);
+
+public:
+    TickScheduler(double period, int max_catch_up);
+
+    // start counting from the current tick (not run)
+    void start();
+
+    // blocks until at least one tick is due, then returns the number of
+    // ticks to run, `first` receives the first of them
+    int wait(tick_t *first);
+    // same without blocking, 0 if no tick is due yet
+    int poll(tick_t *first);
+
+    // until the boundary of the next tick, 0 if it is already due
+    Duration timeBeforeNextTick() const;
+
+    tick_t lastTick() const { return last_tick; }
+    unsigned long long droppedTicks() const { return dropped; }
+    // how late after the tick boundary the last wait/poll returned, in ns
+    unsigned long long lastLateness() const { return last_lateness; }
+};
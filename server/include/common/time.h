@@ -4,20 +4,76 @@
 
 typedef int32_t tick_t;
 
+// A length of time in nanoseconds, signed so that differences can be negative.
+struct Duration
+{
+    int64_t ns = 0;
+
+    static Duration nanoseconds(int64_t ns) { return Duration{ns}; }
+    static Duration microseconds(int64_t us) { return Duration{us * 1000}; }
+    static Duration milliseconds(int64_t ms) { return Duration{ms * 1000000}; }
+
+    int64_t toMicroseconds() const { return ns / 1000; }
+    int64_t toMilliseconds() const { return ns / 1000000; }
+    double toSeconds() const { return (double)ns * 1e-9; }
+
+    Duration operator+(Duration other) const { return Duration{ns + other.ns}; }
+    Duration operator-(Duration other) const { return Duration{ns - other.ns}; }
+    bool operator<(Duration other) const { return ns < other.ns; }
+    bool operator>(Duration other) const { return ns > other.ns; }
+    bool operator<=(Duration other) const { return ns <= other.ns; }
+    bool operator>=(Duration other) const { return ns >= other.ns; }
+};
+
+// A point in time: nanoseconds since Time::startNow on a monotonic clock.
+struct TimePoint
+{
+    int64_t ns = 0;
+
+    Duration operator-(TimePoint other) const { return Duration{ns - other.ns}; }
+    TimePoint operator+(Duration d) const { return TimePoint{ns + d.ns}; }
+    TimePoint operator-(Duration d) const { return TimePoint{ns - d.ns}; }
+    bool operator<(TimePoint other) const { return ns < other.ns; }
+    bool operator>(TimePoint other) const { return ns > other.ns; }
+    bool operator<=(TimePoint other) const { return ns <= other.ns; }
+    bool operator>=(TimePoint other) const { return ns >= other.ns; }
+
+    // same rounding as Time::nowInTicks
+    tick_t toTicks(double period) const { return (tick_t)((ns / 1000000) / (period * 1000)); }
+};
+
+// Monotonic clock: QueryPerformanceCounter on Windows, CLOCK_MONOTONIC
+// elsewhere, or the TSC when built with USE_TSC_CLOCK (calibrated against the
+// OS clock by startNow, only on CPUs with an invariant TSC).
 class Time
 {
-    static unsigned long long start_time;
-    static unsigned long long freq;
+    static unsigned long long start_time; // in counts of the clock
+    static unsigned long long freq;       // counts per second
+
+    // time of the tick being run by the calling thread, see publishFrameTime
+    static thread_local TimePoint frame_time;
+    static thread_local bool has_frame_time;
 
 public:
     static inline tick_t msToClientTicks(unsigned long long ms);
 
     static void startNow();
-    static tick_t Time::msToTicks(unsigned long long ms, double period);
+    static tick_t msToTicks(unsigned long long ms, double period);
     static unsigned long long now();
     static unsigned long long nowInMilliseconds();
-    static tick_t Time::nowInTicks(double period);
+    static unsigned long long nowInNanoseconds();
+    static tick_t nowInTicks(double period);
+    static TimePoint nowPoint();
     static unsigned long long nextDeadline(double period);
     static unsigned long long timeBeforeDeadline(double period);
     static struct timeval timevalOfLongLong(unsigned long long time);
-};
\ No newline at end of file
+    static struct timeval timevalOfDuration(Duration duration); // to the microsecond
+
+    // Reads the clock once for the tick the calling thread is about to run.
+    // Code run during that tick asks frameTime / frameTicks instead of
+    // reading the clock again (the clock is read when nothing was published
+    // on this thread).
+    static void publishFrameTime();
+    static TimePoint frameTime();
+    static tick_t frameTicks(double period);
+};
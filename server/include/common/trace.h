@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+
+#include "common/time.h"
+
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE (1 << 15) // events kept per thread until written, a power of two
+#endif
+#define TRACE_FLUSH_MS 10 // how often the writer empties the buffers
+
+// A zone that ran on a thread, `name` must be a string literal.
+struct TraceEvent
+{
+    const char *name;
+    int64_t start; // ns, see TimePoint
+    int64_t duration;
+    int32_t arg; // id of what the zone worked on, -1 for none
+    int32_t tid;
+};
+
+// Timeline of the zones of all the threads, written as Chrome Trace Event
+// JSON (chrome://tracing, ui.perfetto.dev) while a capture is running.
+// Each thread records its zones in its own ring buffer (single producer,
+// single consumer, a full buffer drops the new events) and a writer thread
+// empties them to the file every TRACE_FLUSH_MS. When no capture runs, a
+// zone costs a relaxed load.
+class Trace
+{
+    static std::atomic<bool> enabled;
+
+    static void write(FILE *file, std::string path); // writer thread
+
+public:
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // records the zones of all threads to `path` for `length`, false if a
+    // capture is already running or the file cannot be opened
+    static bool capture(const char *path, Duration length);
+    static bool isCapturing();
+    // ends a running capture now and waits for its file to be written
+    static void stop();
+
+    // name of the calling thread in the traces
+    static void setThreadName(const char *name);
+
+    static void record(const char *name, int64_t start, int64_t end, int arg);
+};
+
+// Records the time from its construction to its destruction as a zone,
+// if a capture is running.
+class TraceZone
+{
+    const char *name;
+    int arg;
+    int64_t start; // -1 when not tracing
+
+public:
+    TraceZone(const char *name, int arg = -1) : name(name), arg(arg), start(Trace::isEnabled() ? (int64_t)Time::nowInNanoseconds() : -1) {}
+    ~TraceZone()
+    {
+        if (start >= 0)
+            Trace::record(name, start, (int64_t)Time::nowInNanoseconds(), arg);
+    }
+
+    TraceZone(const TraceZone &) = delete;
+    TraceZone &operator=(const TraceZone &) = delete;
+};
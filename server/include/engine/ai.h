@@ -5,33 +5,60 @@
 #include "engine/controller.h"
 #include "engine/world.h"
 
-#include <vector>
+#define CHASE_DEADZONE 2.0f // in pixels, no move along an axis closer than that to the goal
+#define CHASE_STOP_DIST 30.0f // in pixels, from the middle of the chased player
 
+// Makes the controls of entities. An AI only reads the world and writes
+// nothing but the AIState of the entity, so that the controls of many
+// entities can be made in parallel (see AIScheduler).
 class AI
 {
 protected:
-    World *world;
-    std::vector<Entity *> entities;
+    const World *world;
 
-    int getPlayerIndexById(ID id);
+    // fills `state.percept` when the perception stage did not (see Perception),
+    // one player after the other
+    void ensurePercept(const Entity *entity, AIState &state) const;
+    // where to go next to reach `target`: the middle of the next tile down its
+    // flow field, or the target itself on the last tile (or without a field yet)
+    Vec2f findNextGoal(const Vec2f pos, const Player *target) const;
+    // movement bits going from `from` to `to`
+    static uint8_t steer(const Vec2f from, const Vec2f to);
 
 public:
-    AI(World *world);
-    virtual Control makeNextControl(Entity *entity) { return {0}; };
+    AI(const World *world);
+    virtual Control makeNextControl(const Entity *entity, AIState &state) const { return {0}; };
+
+    // whether the AI looks at Percept::target_in_sight and Percept::visible,
+    // lines of sight are not traced for the others
+    virtual bool needsSight() const { return true; }
+
+    // called (from the world thread) when an entity starts or stops using
+    // this AI, eg. to give it some room in tables of the AI
+    virtual void attach(AIState &state){};
+    virtual void detach(AIState &state){};
 };
 
 class LinePath : public AI
 {
-    std::vector<Vec2f> initial_pos;
-    std::vector<Control *> last_ctrl;
+public:
+    double size;
+
+    LinePath(const World *world, double size);
 
-    Control ctrl_left;
-    Control ctrl_right;
+    bool needsSight() const override { return false; }
 
+    Control makeNextControl(const Entity *entity, AIState &state) const override;
+};
+
+// Goes after the closest player, down the flow field of that player (see
+// Pathfinder), and straight at it once on the same tile.
+class Chase : public AI
+{
 public:
-    double size;
+    Chase(const World *world);
 
-    LinePath(World *world, double size);
+    bool needsSight() const override { return false; }
 
-    Control makeNextControl(Entity *entity) override;
-};
\ No newline at end of file
+    Control makeNextControl(const Entity *entity, AIState &state) const override;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "common/job_pool.h"
+#include "common/time.h"
+#include "engine/controller.h"
+
+class Entity;
+class NPC;
+class Player;
+class Perception;
+
+// How often an NPC thinks, from its distance to the closest player
+enum AITier : uint8_t
+{
+    AI_TIER_NEAR = 0, // or in combat
+    AI_TIER_MID = 1,
+    AI_TIER_FAR = 2,
+    AI_TIER_IDLE = 3, // no player in the world
+    N_AI_TIERS
+};
+
+#define AI_NEAR_DIST 600.0f  // in pixels
+#define AI_MID_DIST 1500.0f  // in pixels
+#define AI_COMBAT_TICKS 180  // an NPC stays in combat for that long after being hurt
+#define AI_MAX_THINKS 2048      // per world and per tick
+#define AI_THINK_BUDGET_US 2000 // think time of a tick above which it is counted as over budget
+#define AI_BATCH_SIZE 512       // NPCs thinking in parallel
+
+// thinks done and postponed (over AI_MAX_THINKS), since the last call to collectMetrics
+struct AISchedulerMetrics
+{
+    int thinks[N_AI_TIERS];
+    int postponed;
+    int over_budget;        // ticks whose thinks took more than AI_THINK_BUDGET_US
+    uint64_t max_think_us;  // longest think time of a tick
+};
+
+// Spreads the thinking of NPCs over the ticks. Each NPC thinks every 1, 4,
+// 16 or 60 ticks depending on its tier (see AITier), the tier is updated
+// when it thinks, and NPCs of a tier are staggered by id so that they don't
+// all think on the same tick. Between thinks, their controller repeats the
+// last control.
+// At most AI_MAX_THINKS NPCs think in a tick, the NPCs left are first in line
+// on the next tick. The limit is a count rather than a time so that which
+// NPCs think does not depend on the speed of the machine or the number of
+// threads; the time is only measured for the metrics.
+// NPCs due this tick think by batches: the batch goes through the perception
+// stage, then their AIs run as jobs on the worker
+// threads (the world is read only meanwhile), each writing the control of
+// its NPC in a slot, then the controls are handed to the controllers in the
+// order of the batch. So the result does not depend on the number of threads.
+class AIScheduler
+{
+    std::vector<NPC *> npcs;
+    int next = 0; // where to start on the next tick
+    AISchedulerMetrics metrics = {};
+
+    JobPool jobs;
+    Perception *perception = nullptr;
+    std::vector<NPC *> batch;
+    std::vector<const Entity *> batch_entities; // the same NPCs, for the perception
+    std::unique_ptr<bool[]> batch_needs_sight;
+    std::vector<Percept> percepts;
+    std::vector<Control> decisions; // control made for each NPC of the batch
+
+    AITier computeTier(NPC *npc, tick_t current_tick, const std::vector<Player *> &players) const;
+    void think(int n);
+
+public:
+    AIScheduler();
+
+    // number of threads helping the world thread, 0 to think on the world thread only
+    void setNThreads(int n) { jobs.resize(n); }
+
+    void add(NPC *npc);
+    void remove(Entity *entity); // does nothing if it is not a scheduled NPC
+
+    // perception stage run before the thinks, none by default (AIs look by themselves)
+    void setPerception(Perception *perception) { this->perception = perception; }
+
+    // runs the thinks due at `current_tick`, before entities are updated
+    void update(tick_t current_tick, const std::vector<Player *> &players);
+
+    int size() const { return (int)npcs.size(); }
+    AISchedulerMetrics collectMetrics();
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/deftypes.h"
+#include "engine/ai.h"
+
+namespace tinyxml2
+{
+    class XMLElement;
+}
+
+enum BehaviorOp : uint8_t
+{
+    // composites
+    BT_SELECTOR = 0, // succeeds with the first child that succeeds
+    BT_SEQUENCE = 1, // fails at the first child that fails
+    // conditions, on the closest player (the target)
+    BT_TARGET_WITHIN = 2, // param: distance in pixels
+    BT_IN_SIGHT = 3,      // no wall between the entity and the target, within PERCEPTION_RANGE
+    BT_HEALTH_BELOW = 4,  // param: ratio of max health
+    // actions, they succeed unless they need a target and there is none
+    BT_IDLE = 5,
+    BT_PATROL = 6, // param: distance in pixels, left and right of where the entity started
+    BT_CHASE = 7,
+    BT_FLEE = 8,
+    BT_STRAFE = 9, // param: thinks between two changes of direction
+    BT_SHOOT = 10,
+    N_BT_OPS
+};
+
+// A node of a compiled behavior tree. The nodes of a tree are stored in
+// depth first order: the children of a composite follow it and `next` is the
+// index right after the subtree of the node, ie. where its next sibling is.
+struct BehaviorNode
+{
+    BehaviorOp op;
+    uint16_t next;
+    float param;
+};
+
+struct BehaviorTree
+{
+    std::string name;
+    std::vector<BehaviorNode> nodes; // nodes[0] is the root
+};
+
+// Behavior trees loaded from an XML file (see data/behaviors.xml).
+class Behaviors
+{
+    static std::vector<BehaviorTree> trees;
+
+    static bool compile(const tinyxml2::XMLElement *e, std::vector<BehaviorNode> &nodes);
+
+public:
+    static void loadFromFile(std::string file_path);
+
+    static int nBehaviors() { return (int)trees.size(); };
+    static const BehaviorTree *get(int i) { return &trees[i]; }
+    static const BehaviorTree *get(const std::string &name); // nullptr if unknown
+};
+
+// Runs a behavior tree. What the tree remembers about each entity is kept in
+// the tables of the blackboard, one row per entity using this AI (see
+// AIState::slot). A think only writes the row of its entity.
+class BehaviorAI : public AI
+{
+    struct Blackboard
+    {
+        std::vector<float> origin_x; // where the entity started patrolling
+        std::vector<float> origin_y;
+        std::vector<int8_t> patrol_dir; // -1 left, 1 right
+        std::vector<int8_t> strafe_dir; // -1 clockwise, 1 counter clockwise
+        std::vector<uint16_t> strafe_left; // thinks before the next change of direction
+
+        std::vector<int> free_rows;
+
+        int add();
+        void remove(int row);
+    };
+
+    // what a think knows, shared by the nodes
+    struct Context
+    {
+        const Entity *entity;
+        int row;
+        Vec2f pos; // middle of the entity
+        const Player *target;
+        float target_dist2;
+        bool target_in_sight;
+        Control ctrl;
+    };
+
+    const BehaviorTree *tree;
+    bool needs_sight; // the tree has an in_sight node
+    mutable Blackboard blackboard; // rows only written by the thinks of their entity
+
+    bool run(int node, Context &c) const;
+    void aim(Context &c) const;
+
+public:
+    BehaviorAI(const World *world, const BehaviorTree *tree);
+
+    const BehaviorTree *getTree() const { return tree; }
+
+    bool needsSight() const override { return needs_sight; }
+
+    Control makeNextControl(const Entity *entity, AIState &state) const override;
+    void attach(AIState &state) override;
+    void detach(AIState &state) override;
+};
@@ -1,4 +1,5 @@
 #include "common/vector.hpp"
+#include "engine/raycast.h"
 
 struct TilemapDesc;
 
@@ -6,14 +7,33 @@ struct TilemapDesc;
 bool overlaps(float x1, float y1, float w1, float h1, float x2, float y2, float w2, float h2);
 bool overlaps(Vec2f pos1, Vec2f size1, Vec2f pos2, Vec2f size2);
 
+// Rays are given by a unit direction vector, the versions taking an angle
+// only compute it and call them.
+
 // ray/sphere intersection
+bool intersects(Vec2f ray_origin, Vec2f ray_dir, Vec2f sphere_origin, float sphere_radius);
 bool intersects(Vec2f ray_origin, float ray_angle, Vec2f sphere_origin, float sphere_radius);
 
 // ray/sphere intersection with distance
+float computeDistance(Vec2f ray_origin, Vec2f ray_dir, Vec2f sphere_origin, float sphere_radius);
 float computeDistance(Vec2f ray_origin, float ray_angle, Vec2f sphere_origin, float sphere_radius);
 
-// ray/map intersection
+// ray/map intersection, returns `range` if no wall is closer
+float computeDistance(Vec2f ray_origin, Vec2f ray_dir, float range, const TilemapDesc *map);
 float computeDistance(Vec2f ray_origin, float ray_angle, float range, const TilemapDesc *map);
 
+// ray/map intersection for all the rays of a batch at once (skip is ignored),
+// `out_dist[i]` receives the distance to the first wall or the range of the ray
+void computeDistances(const RayBatch &rays, const TilemapDesc *map, float *out_dist);
+
+// moves the box at `pos` (top left corner) by `delta` and stops it against the
+// first solid tile on its way, x first then y. Every tile swept by the box is
+// tested, so fast or large boxes can't go through walls. Outside of the map
+// counts as solid. Returns the new position of the box.
+Vec2f sweepBox(Vec2f pos, Vec2f size, Vec2f delta, const TilemapDesc *map);
+
+// same as above but always scans, kept to check the fast path of sweepBox
+Vec2f sweepBoxScan(Vec2f pos, Vec2f size, Vec2f delta, const TilemapDesc *map);
+
 float computeOverlapX(Vec2f pos1, Vec2f last_pos1, Vec2f size1, Vec2f pos2, Vec2f last_pos2, Vec2f size2);
 float computeOverlapY(Vec2f pos1, Vec2f last_pos1, Vec2f size1, Vec2f pos2, Vec2f last_pos2, Vec2f size2);
\ No newline at end of file
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+#include "common/bits.h"
+
+// maps are cut in chunks of 64 * 64 tiles (see tile_chunks), grouped in
+// regions of 8 * 8 chunks
+#define CHUNK_SHIFT 6
+#define CHUNK_SIZE (1 << CHUNK_SHIFT)
+#define REGION_SHIFT (CHUNK_SHIFT + 3)
+#define REGION_SIZE (1 << REGION_SHIFT)
+
+// what a region contains
+enum RegionState : uint8_t
+{
+    REGION_EMPTY = 0,
+    REGION_SOLID = 1,
+    REGION_MIXED = 2,
+};
+
+// Solid/empty state of the tiles of a map, packed in 64 bits words.
+// Each row starts on a word boundary, and the map is surrounded by a ring of
+// solid tiles so that any x in [-1, width] and y in [-1, height] can be read
+// without bounds checks, and every scan stops on the border at the latest.
+// A transposed copy is kept so that columns can be scanned the same way.
+// Once summarized, the state of each region is kept up to date. Only
+// raycasts use it, to cross an empty region in one step where the distance field saturates at MAX_CLEARANCE, which only
+// happens in open areas of MAX_CLEARANCE tiles or more. Swept boxes scan the
+// words and never skip chunks. The words themselves are not chunked, they are
+// one block either owned by the map or borrowed (eg. from a cooked map file
+// mapped in memory).
+class CollisionMap
+{
+    int width;
+    int height;
+
+    int row_stride; // words per row
+    int column_stride; // words per column
+    std::vector<uint64_t> storage; // empty if borrowed
+    uint64_t *rows;
+    uint64_t *columns;
+
+    // empty until summarize is called
+    int regions_x;
+    std::vector<uint8_t> region_states;
+
+    RegionState computeRegionState(const int rx, const int ry) const;
+
+public:
+    // empty map
+    CollisionMap(const int width, const int height);
+    // uses words written by an other map (see rowData/columnData)
+    CollisionMap(const int width, const int height, uint64_t *rows, uint64_t *columns);
+    CollisionMap(const CollisionMap &) = delete;
+
+    const uint64_t *rowData() const { return rows; }
+    const uint64_t *columnData() const { return columns; }
+    size_t rowDataSize() const; // in words
+    int rowStride() const { return row_stride; }
+    size_t columnDataSize() const;
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    inline bool get(const int x, const int y) const;
+    void set(const int x, const int y, const bool solid = true);
+
+    // computes the state of every region, O(width * height / 64)
+    void summarize();
+
+    // state of the region of tile (x, y), which must be in the map
+    RegionState getRegionState(const int x, const int y) const { return (RegionState)region_states[(size_t)(y >> REGION_SHIFT) * regions_x + (x >> REGION_SHIFT)]; }
+
+    // first/last solid tile of [x0, x1] on any of the rows y0 to y1, x1 + 1
+    // or x0 - 1 if there is none, coordinates out of [-1, width] or
+    // [-1, height] are clamped
+    inline int findFirstSolidInRows(int x0, int x1, int y0, int y1) const;
+    inline int findLastSolidInRows(int x0, int x1, int y0, int y1) const;
+    // same on [y0, y1] of the columns x0 to x1
+    inline int findFirstSolidInColumns(int y0, int y1, int x0, int x1) const;
+    inline int findLastSolidInColumns(int y0, int y1, int x0, int x1) const;
+
+    // true if no tile of [x0, x1] * [y0, y1] is solid, for areas within
+    // [-1, width] * [-1, height] of at most two rows and two words (always
+    // false for bigger ones, which the scans above check no slower)
+    inline bool isSmallAreaEmpty(int x0, int y0, int x1, int y1) const;
+};
+
+// these are called in the inner loops of raycasts and collisions, so they
+// live in the header
+
+// with the padding, tile x is bit x + 1 of its row and tile y bit y + 1 of its column
+
+inline int clampCollisionCoord(int v, int low, int high)
+{
+    return v < low ? low : v > high ? high : v;
+}
+
+// first/last set bit of [b0, b1] in any of the lines l0 to l1 (stride words
+// apart), b1 + 1 or b0 - 1 if there is none
+int scanLinesForward(const uint64_t *lines, const size_t stride, const int l0, const int l1, const int b0, const int b1);
+int scanLinesBackward(const uint64_t *lines, const size_t stride, const int l0, const int l1, const int b0, const int b1);
+
+// Sweeps are shorter than a tile and boxes cover at most two lines: one word
+// of each, read without any loop. Otherwise (or if the bits left the map)
+// false is returned and the scan goes through every word.
+inline bool getWordOfLines(const uint64_t *lines, const size_t stride, const int l0, const int l1, const int b0, const int b1, uint64_t &word)
+{
+    if (b0 >> 6 != b1 >> 6 || l1 - l0 > 1)
+        return false;
+
+    const uint64_t *line = &lines[(size_t)l0 * stride + (b0 >> 6)];
+    word = (line[0] | line[(size_t)(l1 - l0) * stride]) & (~(uint64_t)0 << (b0 & 63)) & (~(uint64_t)0 >> (63 - (b1 & 63)));
+    return true;
+}
+
+inline int findFirstBitOfLines(const uint64_t *lines, const size_t stride, const int l0, const int l1, const int b0, const int b1)
+{
+    uint64_t word;
+    if (!getWordOfLines(lines, stride, l0, l1, b0, b1, word))
+        return scanLinesForward(lines, stride, l0, l1, b0, b1);
+    return word ? (b0 & ~63) + countTrailingZeros64(word) : b1 + 1;
+}
+
+inline int findLastBitOfLines(const uint64_t *lines, const size_t stride, const int l0, const int l1, const int b0, const int b1)
+{
+    uint64_t word;
+    if (!getWordOfLines(lines, stride, l0, l1, b0, b1, word))
+        return scanLinesBackward(lines, stride, l0, l1, b0, b1);
+    return word ? (b0 & ~63) + highestBit64(word) : b0 - 1;
+}
+
+inline bool CollisionMap::get(const int x, const int y) const
+{
+    int bit = x + 1;
+    return (rows[(size_t)(y + 1) * row_stride + (bit >> 6)] >> (bit & 63)) & 1;
+}
+
+inline int CollisionMap::findFirstSolidInRows(int x0, int x1, int y0, int y1) const
+{
+    return findFirstBitOfLines(rows, row_stride, clampCollisionCoord(y0, -1, height) + 1, clampCollisionCoord(y1, -1, height) + 1,
+                               clampCollisionCoord(x0, -1, width) + 1, clampCollisionCoord(x1, -1, width) + 1) - 1;
+}
+
+inline int CollisionMap::findLastSolidInRows(int x0, int x1, int y0, int y1) const
+{
+    return findLastBitOfLines(rows, row_stride, clampCollisionCoord(y0, -1, height) + 1, clampCollisionCoord(y1, -1, height) + 1,
+                              clampCollisionCoord(x0, -1, width) + 1, clampCollisionCoord(x1, -1, width) + 1) - 1;
+}
+
+inline int CollisionMap::findFirstSolidInColumns(int y0, int y1, int x0, int x1) const
+{
+    return findFirstBitOfLines(columns, column_stride, clampCollisionCoord(x0, -1, width) + 1, clampCollisionCoord(x1, -1, width) + 1,
+                               clampCollisionCoord(y0, -1, height) + 1, clampCollisionCoord(y1, -1, height) + 1) - 1;
+}
+
+inline int CollisionMap::findLastSolidInColumns(int y0, int y1, int x0, int x1) const
+{
+    return findLastBitOfLines(columns, column_stride, clampCollisionCoord(x0, -1, width) + 1, clampCollisionCoord(x1, -1, width) + 1,
+                              clampCollisionCoord(y0, -1, height) + 1, clampCollisionCoord(y1, -1, height) + 1) - 1;
+}
+
+inline bool CollisionMap::isSmallAreaEmpty(int x0, int y0, int x1, int y1) const
+{
+    // a box that moved less than a tile, read without any loop (whose trip
+    // count would be as hard to predict as a coin toss)
+    int b0 = x0 + 1;
+    int b1 = x1 + 1;
+    if (x0 < -1 || x1 > width || y0 < -1 || y1 > height || y1 - y0 > 1)
+        return false;
+
+    const uint64_t *row = &rows[(size_t)(y0 + 1) * row_stride];
+    const size_t next_row = (size_t)(y1 - y0) * row_stride;
+    const int w0 = b0 >> 6;
+    const int w1 = b1 >> 6;
+    uint64_t first_mask = ~(uint64_t)0 << (b0 & 63);
+    uint64_t last_mask = ~(uint64_t)0 >> (63 - (b1 & 63));
+    if (w0 == w1)
+        return ((row[w0] | row[w0 + next_row]) & first_mask & last_mask) == 0;
+    return w1 == w0 + 1 && ((row[w0] | row[w0 + next_row]) & first_mask) == 0 && ((row[w1] | row[w1 + next_row]) & last_mask) == 0;
+}
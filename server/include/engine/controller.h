@@ -5,7 +5,11 @@
 
 #include "common/time.h"
 #include "common/deftypes.h"
+#include "common/inline_vector.hpp"
 #include "common/ring.hpp"
+#include "common/vector.hpp"
+#include "engine/game_config.h"
+#include "engine/perception.h"
 
 class Entity;
 class AI;
@@ -33,10 +37,15 @@ struct Control
 #define LEFT(movement) ((movement & MOVE_LEFT) == MOVE_LEFT)
 #define RIGHT(movement) ((movement & MOVE_RIGHT) == MOVE_RIGHT)
 
+#define MAX_CONTROLS_PER_UPDATE (ACK_SIZE * 8) // controls applied in one update, as many as the history holds
+
+// controls to apply in an update, they point into the history of the controller
+typedef InlineVector<Control *, MAX_CONTROLS_PER_UPDATE> ControlList;
+
 class Controller
 {
 protected:
-    Ring<Control> control_history;
+    Ring<Control, MAX_CONTROLS_PER_UPDATE> control_history;
     int last_ctrl_tick = -1;
 
     // server-side client tick at which getControls has returned controls
@@ -48,27 +57,119 @@ protected:
 public:
     Controller();
 
+    // forget all controls, used when the controller is reused
+    virtual void reset();
+
     virtual void update(Entity *entity, tick_t tick){};
 
     // clients updates faster than server,
     // server needs to read several controls per step
-    const std::vector<Control *> getControls(tick_t tick);
+    // (written in `out`, cleared first, at most MAX_CONTROLS_PER_UPDATE)
+    virtual void getControls(tick_t tick, ControlList &out);
+
+    // false if a control of that tick was already there
+    bool registerControl(Control &ctrl);
+
+    // latest control tick received (0 before the first one), and the
+    // controls received among the MAX_CONTROLS_PER_UPDATE up to it: bit i
+    // for tick getLastReceivedTick() - i
+    tick_t getLastReceivedTick() const { return control_history.getHeadId(); }
+    uint64_t makeAck() const { return control_history.makeAck(); }
+};
+
+#define JITTER_GAIN (1.0f / 32)  // weight of a new sample in the transit mean and deviation
+#define JITTER_K 2.0f            // playout delay = transit mean + JITTER_K * transit deviation
+#define JITTER_MAX_MARGIN 8.0f   // in ticks, delay added over the mean transit at most (stays in the history)
+#define JITTER_MIN_MARGIN 0.5f   // in ticks
+#define JITTER_HYSTERESIS 1.5f   // in ticks, how much too long the delay can be before it goes down
 
-    void registerControl(Control &ctrl);
+// what the jitter buffers of the players went through, since last collected
+struct InputMetrics
+{
+    int released;  // controls applied
+    int underruns; // ticks played without a control
+    int late;      // controls arrived after their tick was played
+    int depth_sum; // controls held ahead of the playout tick, summed over ticks
+    int max_depth;
+    int resims;        // players rewound for late controls
+    int resim_ticks;   // ticks simulated again
+    int resim_dropped; // late controls too old to rewind to
 };
 
+// Jitter buffer: controls are held for an adaptive delay then released one
+// per tick, at the tick they were made plus the delay. The delay follows the
+// transit of the controls (arrival tick - control tick, clock offset included)
+// as an exponentially weighted mean + JITTER_K deviations, so that a burst of
+// late packets doesn't turn into idle ticks followed by double moves.
 class PlayerController : public Controller
 {
+    bool has_transit = false;
+    float transit_mean = 0;
+    float transit_dev = 0;
+    tick_t delay = 0;         // playout delay in ticks
+    tick_t playout_tick = -1; // tick of the last control played, -1 before the first
+    InputMetrics metrics = {};
+
+    void updateDelay();
+
 public:
     PlayerController();
+
+    void reset() override;
+
+    // a control made at `ctrl_tick` was received at `arrival_tick` (not for
+    // the redundant copies, they are late on purpose)
+    void measureArrival(tick_t ctrl_tick, tick_t arrival_tick);
+
+    void getControls(tick_t tick, ControlList &out) override;
+
+    tick_t getPlayoutTick() const { return playout_tick; }
+    tick_t getOldestTick() const { return control_history.getTailId(); } // controls before are forgotten
+    const Control *getControl(tick_t tick) { return control_history.getById(tick); }
+
+    tick_t getDelay() const { return delay; }
+    InputMetrics collectMetrics();
 };
 
+// What an AI remembers about one entity, kept by the AIController of that
+// entity (so an AI can be shared by many entities) and cleared when the
+// entity is reused.
+struct AIState
+{
+    bool started = false; // false until the first control is made
+    Vec2f origin;         // where the entity was on its first control
+    uint8_t last_movement = 0;
+    int slot = -1; // row of the entity in the tables of its AI, if the AI has some
+    Percept percept; // what the entity perceives for its current think
+};
+
+// Asks its AI for a control. On its own it does so every tick, under an
+// AIScheduler the AI only thinks when the scheduler says so (the scheduler
+// makes the control and hands it over with setControl) and the last control
+// is repeated in between.
 class AIController : public Controller
 {
     std::shared_ptr<AI> ai;
+    AIState state;
+    Control last_control;
+    bool has_control = false;
+    bool scheduled = false;
 
 public:
-    AIController(std::shared_ptr<AI> ai);
+    // scheduling state, see AIScheduler
+    tick_t next_think = 0;
+    tick_t combat_until = 0; // thinks at full rate until then
+    float last_health = 0;
+
+    AIController(std::shared_ptr<AI> ai = nullptr);
+
+    void setAI(std::shared_ptr<AI> ai);
+    const AI *getAI() const { return ai.get(); }
+    AIState *getState() { return &state; }
+    void setScheduled(bool scheduled) { this->scheduled = scheduled; }
 
+    void reset() override;
+    void think(Entity *entity);
+    void setControl(const Control &ctrl);
     void update(Entity *entity, tick_t current_tick) override;
 };
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+
+// Binary map written offline by the mapcook tool (see Map::cook) and mapped
+// in memory by Map::load when the path ends with ".cmap". Everything the
+// server needs is stored ready to use: tiles, collision words, distance
+// field, tileset (solid bits and the image sent to the clients) and the
+// object groups, so nothing is parsed or rebuilt at startup.
+//
+// Layout: a CookedMapHeader then the sections, each one starting on an 8
+// bytes boundary. Numbers are stored little endian.
+
+#define COOKED_MAP_MAGIC "MAPC"
+#define COOKED_MAP_EXTENSION ".cmap"
+
+// bump it whenever the layout of a section changes, older files are refused
+const uint32_t COOKED_MAP_VERSION = 3;
+
+// largest width/height (in tiles) of a cooked map and of its tileset, bigger
+// headers are taken for corrupted ones
+#define COOKED_MAP_MAX_SIZE 16384
+
+enum CookedSectionType
+{
+    COOKED_TILE_CHUNKS = 0,  // CookedChunk of each chunk of TileChunks, row by row
+    COOKED_TILE_PAGES,       // CHUNK_SIZE * CHUNK_SIZE TILE per chunk that is not uniform
+    COOKED_COLLISION_ROWS,   // CollisionMap::rowData
+    COOKED_COLLISION_COLUMNS, // CollisionMap::columnData
+    COOKED_CLEARANCE,        // DistanceField::data
+    COOKED_TILESET_SOLID,    // one byte per tileset tile
+    COOKED_TILESET_IMAGE,    // bytes of the tileset image file
+    COOKED_GROUPS,           // enemy and spawn groups, see writeGroups in cooked_map.cpp
+    N_COOKED_SECTIONS
+};
+
+struct CookedSection
+{
+    uint64_t offset; // from the beginning of the file
+    uint64_t size;   // in bytes
+};
+
+struct CookedChunk
+{
+    uint32_t uniform; // every tile of the chunk if page is 0
+    uint32_t page;    // 1 + index of its page in COOKED_TILE_PAGES, 0 if none
+};
+
+struct CookedMapHeader
+{
+    char magic[4];
+    uint32_t version;
+
+    int32_t width;
+    int32_t height;
+    uint8_t tile_size;
+    uint8_t scale; // world positions of the groups are already scaled
+    uint8_t tileset_tile_size;
+    uint8_t padding;
+    int32_t tileset_width;
+    int32_t tileset_height;
+
+    CookedSection sections[N_COOKED_SECTIONS];
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+class CollisionMap;
+
+#define MAX_CLEARANCE 255
+
+// For each tile, the Chebyshev distance (in tiles) to the closest solid tile:
+// 0 on solid tiles, 1 next to them, ... saturated at MAX_CLEARANCE.
+// A tile with clearance d is the center of a (2d - 1) * (2d - 1) square of
+// empty tiles. Like the collision map, it has a border of solid tiles so that
+// x in [-1, width] and y in [-1, height] can be read without bounds checks.
+class DistanceField
+{
+    int width;
+    int height;
+    int stride;
+    std::vector<uint8_t> storage; // empty if borrowed
+    const uint8_t *field;
+
+public:
+    DistanceField();
+
+    // two pass chamfer over the collision map, O(width * height)
+    void build(const CollisionMap &collisions);
+    // uses a field built by an other one (see data)
+    void borrow(const int width, const int height, const uint8_t *data);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    const uint8_t *data() const { return field; }
+    size_t dataSize() const { return (size_t)stride * (height + 2); }
+
+    uint8_t get(const int x, const int y) const { return field[(size_t)(y + 1) * stride + x + 1]; }
+};
@@ -1,12 +1,44 @@
 #pragma once
 
+#include <memory>
 #include <string>
 
 #include "common/vector.hpp"
+#include "engine/entity.h"
+#include "engine/controller.h"
 
+// an enemy placed in a map
 struct Enemy
 {
     std::string name;
     Vec2f pos;
-    int difficulty;
-};
\ No newline at end of file
+    int difficulty = 0;
+    int count = 1;    // number of NPCs spawned for this object
+    float spread = 0; // radius (in pixels) around pos in which they are scattered
+    std::string behavior; // name of a behavior (see data/behaviors.xml), empty for the default AI
+};
+
+// spawning rules of an enemy group, read from the properties of its object group
+struct WaveRules
+{
+    int wave_size = 0;        // NPCs spawned per wave, 0 to spawn the whole group at once
+    float wave_period = 0;    // in sec, between two waves
+    float respawn_delay = -1; // in sec, negative to never respawn
+};
+
+// An entity controlled by an AI. NPCs are stored in the pool of an
+// EntitySpawner and reused when they die.
+class NPC : public Entity
+{
+protected:
+    AIController ai_controller;
+
+public:
+    int slot = -1; // spawn slot in the spawner
+
+    NPC();
+
+    void reset(ID id, std::string name, const Vec2f pos, std::shared_ptr<AI> ai, float max_health = 100);
+
+    AIController *getAIController() { return &ai_controller; }
+};
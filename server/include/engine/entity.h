@@ -43,11 +43,13 @@ protected:
 
     Random random_generator;
     Controller *controller;
+    bool owns_controller = true; // false if controller is a member of a subclass
 
     tick_t tick_next_shoot = 0;
 
     virtual void doMapCollisions(const TilemapDesc *map);
     virtual void applyControl(const Control *control);
+    void applyMovement(const Control *control); // the part of a control that moves the entity
 
 public:
     ID id;
@@ -71,7 +73,12 @@ public:
     Entity(ID id, EntityType type = ENTITY, std::string name = "__entity__", float max_health = 100, Controller *controller = nullptr);
     ~Entity();
 
-    virtual const std::vector<Control *> update(const tick_t current_tick, const TilemapDesc *map);
+    // bring back the entity to the state it had when it was created, keeps
+    // the storage of its name and weapons (used by pools)
+    void reset(ID id, std::string name, float max_health = 100);
+
+    // applies the controls of this tick, they are written in `ctrls`
+    virtual void update(const tick_t current_tick, const TilemapDesc *map, ControlList &ctrls);
 
     bool isAlive();
     void hurt(const float damage);
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "common/vector.hpp"
+
+class CollisionMap;
+
+#define FLOW_UNREACHED 0xFFFF
+#define FLOW_WALL 0xFFFE
+#define FLOW_MAX_DIST 0xFFFD // stored value past which tiles are left unreached (~49000 steps)
+
+// distances are stored relative to the target, which a search stores as
+// FLOW_ORIGIN and each repair lowers by the steps the target took
+#define FLOW_ORIGIN 0x4000
+#define FLOW_REPAIR_RADIUS 16    // steps around the new target made exact by a repair, at least
+#define FLOW_REPAIR_MAX_DRIFT 64 // steps of repairs after which a search is started
+
+// Distance (in steps) from every tile to a target tile, over the empty tiles
+// of the map with 8 neighbours (diagonal steps cannot cut wall corners).
+// Every entity heading to the target goes down the field: its next tile is
+// the neighbour closest to the target, an O(1) lookup whatever the map size.
+//
+// When the target moves to a tile reached by the field, the field is
+// repaired locally (see repair): tiles up to FLOW_REPAIR_RADIUS steps from
+// the new target get their exact distance, and every other one keeps its
+// old distance plus the steps the target took, which is never below its new
+// one. Going down the field still always ends on the new target, far tiles
+// just head to where it was, so paths get longer as repairs pile up. Once
+// the target drifted FLOW_REPAIR_MAX_DRIFT steps, or if it went to a tile
+// the field does not reach, a full search is started.
+//
+// Searches are breadth first and spread over several ticks (see step). The
+// field is double buffered: while a new field is being computed the previous
+// one is still used, and repaired. A search is never restarted; once done,
+// its field replaces the current one if the target drifted less from it, and
+// is repaired to the latest target, else it is dropped. At PATHFINDING_BUDGET a
+// 2048 * 2048 map takes ~370 ticks (~6 s) per search, which only limits how
+// often the far tiles get exact again.
+// Like the collision map, fields have a border of walls so that neighbours
+// can be read without bounds checks.
+class FlowField
+{
+    const CollisionMap *collisions;
+    int width;
+    int height;
+    int stride;
+
+    std::vector<uint16_t> front; // complete, empty until the first search is done
+    std::vector<uint16_t> back;  // being computed
+    Vec2i front_target;
+    Vec2i back_target;
+    Vec2i wanted_target; // latest tile given to retarget
+    int origin;          // stored value of front_target
+    int drift;           // steps of the repairs since the last search
+
+    // scratch memory of repairs, the box of tiles around the new target
+    std::vector<uint8_t> repair_seen;
+    std::vector<int> repair_queue;
+
+    // search state
+    bool searching;
+    int reset_rows; // rows of `back` reset from the collision map so far
+    int queue_head;
+    int queue_tail;
+
+    void start();
+    int resetRows(int budget);
+
+public:
+    FlowField(const CollisionMap *collisions);
+
+    // asks for a field towards `target`, ignored if it is not an empty tile
+    void retarget(const Vec2i target);
+
+    bool needsSearch() const;
+    // true if the target moved to a tile reached by the field, at most
+    // FLOW_REPAIR_MAX_DRIFT steps away
+    bool canRepair() const;
+    // moves the field to the latest target without a search, O(radius^2)
+    // where the radius is FLOW_REPAIR_RADIUS or the steps taken if more.
+    // Returns the work done, in tiles.
+    int repair();
+    bool isSearching() const { return searching; }
+    bool isReady() const { return !front.empty(); }
+    Vec2i getTarget() const { return front_target; }
+
+    // Starts a search if needed, then goes on with it for about `budget`
+    // tiles. Returns the work done, in tiles. The new field replaces the
+    // current one when done.
+    // `queue` is scratch memory that must be left untouched until the search
+    // is done, so it can be shared by fields searching one at a time.
+    int step(int budget, std::vector<int> &queue);
+
+    // FLOW_UNREACHED out of the map, on walls, or if there is no path
+    uint16_t getDistance(const int x, const int y) const
+    {
+        if (front.empty() || x < -1 || x > width || y < -1 || y > height)
+            return FLOW_UNREACHED;
+        uint16_t d = front[(size_t)(y + 1) * stride + x + 1];
+        return d >= FLOW_WALL ? FLOW_UNREACHED : d - origin;
+    }
+
+    // next tile on the way to the target from (x, y), returns false if there
+    // is none (no path, no field yet, or already on the target)
+    bool getNextTile(const int x, const int y, Vec2i *next) const;
+    bool getNextTile(const Vec2i xy, Vec2i *next) const { return getNextTile(xy.x, xy.y, next); }
+};
@@ -5,6 +5,7 @@
 #define SERVER_RATE 20
 #define SERVER_PERIOD (1.0f / SERVER_RATE)
 #define MAX_PING ((unsigned long long)1500) // in msec
+#define MAX_CATCH_UP_TICKS 4 // max number of client ticks simulated on a late wakeup
 
 #define NAME_SIZE 50 // max size of names
 #define MAX_N_WEAPONS 4 // max number of weapon that an entity can carry
@@ -13,6 +14,11 @@
 
 #define SEPARATE_BIAS 4 // cf. HaxeFlixel collision engine implementation
 #define ACK_SIZE 2 // number of bytes, ie 16 frames
+#define MAX_REDUNDANT_CONTROLS 8 // earlier controls a client can repeat in a control frame
+#define MAX_RESIM_TICKS 64 // player ticks resimulated per world update at most, for late controls
+#define MAX_PROJECTILES 1024 // max number of bullets in flight in a world
+#define AOI_RADIUS 1000.0f // in pixels, entities and projectile events further from a player are not sent to it
+#define MAX_SNAPSHOT_SIZE 65500 // in bytes, header included, a snapshot must fit in one UDP datagram (65507)
 
 
 #define OP_STATIC_INFO 12
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "common/deftypes.h"
+#include "common/histogram.h"
+#include "common/profiler.h"
+#include "common/time.h"
+#include "network/network.h"
+#include "engine/world.h"
+
+class Map;
+
+// phases of a tick of a match, timed by the match thread
+enum MatchPhase
+{
+    MATCH_PHASE_INBOX,    // dropped players and received frames
+    MATCH_PHASE_UPDATE,   // world.update, once per client tick run
+    MATCH_PHASE_SNAPSHOT, // makeSnapshot and remember
+    MATCH_PHASE_ENCODE,   // snapshot of one player
+    MATCH_PHASE_SEND,     // to one player
+    N_MATCH_PHASES
+};
+
+extern const char *const MATCH_PHASE_NAMES[N_MATCH_PHASES];
+
+// Tick time statistics of a match, accumulated since the last call to
+// Match::collectMetrics.
+struct MatchMetrics
+{
+    int match_id;
+    int n_players;
+    int n_entities;
+    int n_ticks;
+    int n_wakeups;       // a wakeup runs one client tick, or several when catching up
+    double mean_tick_ms; // time spent in world.update + snapshots per wakeup
+    double max_tick_ms;
+    int missed_server_ticks;
+    int dropped_ticks; // client ticks skipped by the catch-up policy
+    int ai_thinks;     // AIs that made a new control, all tiers
+    int ai_postponed;  // thinks delayed to the next tick by AI_MAX_THINKS
+    int ai_over_budget; // ticks whose thinks took more than AI_THINK_BUDGET_US
+    int ai_max_think_us;
+    InputMetrics input; // jitter buffers of the players
+
+    // how late the match thread woke up after tick boundaries, in ns
+    uint64_t jitter_p50;
+    uint64_t jitter_p99;
+    uint64_t jitter_max;
+
+    PhaseStats phases[N_MATCH_PHASES];
+};
+
+// An independent game instance: its own World, updated by its own thread.
+// Frames are routed to it by the MatchManager from the network thread, the
+// match answers through the shared UDPServer.
+class Match
+{
+    int id;
+    World world;
+    Map *map;
+    UDPServer *network;
+
+    std::thread thread;
+    std::atomic<bool> running;
+    int cpu; // core the thread is pinned to, -1 for none
+
+    // filled by the network thread, drained by the match thread
+    std::mutex inbox_mutex;
+    std::queue<NetworkFrame> inbox;
+    std::vector<ID> lost_peers;
+    // answers to the peers that asked for a world config, drained by the
+    // network thread (see takeJoins)
+    std::vector<ID> accepted_peers;
+    std::vector<ID> rejected_peers;
+
+    std::vector<ID> new_connections;
+
+    std::mutex metrics_mutex;
+    MatchMetrics metrics;
+    Histogram jitter;
+    Profiler profiler; // MatchPhase durations
+
+    void run();
+    void handleFrame(const NetworkFrame &frame);
+    void sendSnapshots(tick_t client_tick);
+    void answerJoin(const ID id, const bool accepted);
+
+public:
+    Match(int id, Map *map, UDPServer *network, int cpu = -1);
+    ~Match();
+
+    int getId() const { return id; }
+
+    // only safe to use before start (eg. to add AI entities)
+    World *getWorld() { return &world; }
+
+    void start();
+    void stop();
+
+    // called from the network thread
+    void push(const NetworkFrame &frame);
+    void dropPeer(const ID id);
+    // peers that got a player/were refused since the last call
+    void takeJoins(std::vector<ID> &accepted, std::vector<ID> &rejected);
+
+    MatchMetrics collectMetrics();
+};
+
+// Runs several matches in one process and routes each peer to its match.
+// A peer asking for a world config is sent to the match with the fewest
+// players, and belongs to it once the match created its player. Refused
+// peers are forgotten and can ask again.
+class MatchManager
+{
+    UDPServer *network;
+    std::vector<std::unique_ptr<Match>> matches;
+    std::unordered_map<ID, Match *> peer_match;    // peers with a player
+    std::unordered_map<ID, Match *> pending_peers; // asked for a config, not answered yet
+    std::vector<ID> accepted;                      // scratch of update
+    std::vector<ID> rejected;
+
+    Match *leastLoaded();
+
+public:
+    MatchManager(UDPServer *network);
+    ~MatchManager();
+
+    // threads are pinned to consecutive cores starting at `first_cpu` (-1 to not pin them)
+    void create(int n, Map *map, int first_cpu = -1);
+
+    int size() const { return (int)matches.size(); }
+    Match *get(int i) { return matches[i].get(); }
+
+    void start();
+    void stop();
+
+    // settles the peers the matches accepted or refused since the last call
+    void update();
+
+    // returns false if the frame could not be routed
+    bool route(const NetworkFrame &frame);
+    void dropPeer(const ID id);
+
+    std::vector<MatchMetrics> collectMetrics();
+};
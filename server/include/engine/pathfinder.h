@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "common/deftypes.h"
+#include "engine/flow_field.h"
+
+struct TilemapDesc;
+class Player;
+
+#define PATHFINDING_BUDGET 10000 // tiles expanded per tick, shared by all the searches of a world
+
+// Flow fields towards the players of a world, shared by every NPC chasing
+// the same player. Each player gets a field, which follows it from tile to
+// tile: a player that moved gets its field repaired around its new tile
+// (see FlowField) at the start of the update. Searches run one at a time
+// (they share their queue) and are spread over the ticks so that the cost of
+// a tick stays bounded, fields take turns: with N players moving on a
+// 2048 * 2048 map, the far tiles of a field are exact again every ~N * 6 s.
+class Pathfinder
+{
+    struct Target
+    {
+        ID id;
+        std::unique_ptr<FlowField> field;
+    };
+
+    const TilemapDesc *map;
+    std::vector<Target> targets;
+    int next_target = 0;          // first one to look at for the next search
+    FlowField *active = nullptr; // field with a search in progress
+    std::vector<int> queue;       // of the search in progress
+
+public:
+    Pathfinder(const TilemapDesc *map);
+
+    const TilemapDesc *getTilemap() const { return map; }
+
+    // adds fields for new players, moves the targets of the fields, drops
+    // those of players that left, repairs the fields of the players that
+    // moved and runs the searches in progress, for at most PATHFINDING_BUDGET
+    // tiles
+    void update(const std::vector<Player *> &players);
+
+    // field towards player `id`, nullptr if it joined after the last update.
+    // The field may not be ready yet (see FlowField::isReady).
+    // Read only, AIs call it from several threads.
+    const FlowField *getField(const ID id) const;
+
+    int getNFields() const { return (int)targets.size(); }
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include "common/deftypes.h"
+#include "common/time.h"
+#include "engine/raycast.h"
+
+class Entity;
+class Player;
+struct TilemapDesc;
+
+#define PERCEPTION_RANGE 1000.0f // in pixels, players further than that are never seen
+
+// What an entity knows about the players when it thinks, see Perception.
+struct Percept
+{
+    bool valid = false;             // false until the perception stage filled it
+    const Player *target = nullptr; // closest alive player, at any distance
+    float target_dist2 = 0;         // squared distance to the target
+    bool target_in_sight = false;   // no wall between the entity and its target, within PERCEPTION_RANGE
+    const Player *visible = nullptr; // closest player in sight, nullptr if none (or not asked for)
+    float visible_dist2 = 0;
+};
+
+// Answers the "which players do I see, which one is the closest" queries of
+// all the NPCs thinking in a tick at once, before their AIs run.
+// The positions of the alive players are packed in arrays once per tick (a
+// world has at most MAX_PEERS players, scanning them all is cheaper than any
+// spatial structure), the lines of sight of all the pairs in range are traced
+// in one batch, one ray per candidate. Nothing is shared between candidates:
+// only NPC -> player lines are asked for and each NPC thinks at most once per
+// tick, so a pair never comes twice in a tick.
+class Perception
+{
+    const TilemapDesc *map;
+
+    // alive players of the tick
+    std::vector<const Player *> players;
+    std::vector<float> player_x; // middle
+    std::vector<float> player_y;
+
+    // scratch buffers
+    RayBatch rays;
+    std::vector<float> ray_dist;
+    std::vector<int> candidate_start; // candidates of entity i are [candidate_start[i], candidate_start[i + 1])
+    std::vector<int> candidates;      // index in `players`
+    std::vector<float> candidate_dist2;
+    std::vector<uint8_t> sight;       // of each candidate, its ray has the same index
+
+public:
+    Perception(const TilemapDesc *map);
+
+    // packs the alive players of the tick
+    void update(const std::vector<Player *> &players);
+
+    // fills the percepts of `entities[0, n)`, lines of sight are only traced
+    // for the entities with `needs_sight[i]` (the others only get a target)
+    void perceive(const Entity *const *entities, const bool *needs_sight, int n, Percept *percepts);
+};
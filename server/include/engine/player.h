@@ -8,6 +8,14 @@
 class Player : public Entity
 {
 protected:
+    PlayerController player_controller;
+
+    // where the player was after each tick played, to rewind to when a
+    // control arrives for a tick already played
+    Ring<Vec2f, MAX_CONTROLS_PER_UPDATE> pos_history;
+    tick_t rewind_from = -1; // earliest tick played without its control, -1 if none
+    InputMetrics resim_metrics = {};
+
     void applyControl(const Control *control) override;
 
 public:
@@ -15,8 +23,21 @@ public:
     tick_t client_tick = 0;
     bool ready = false;
 
+    Player();
     Player(ID id, sockaddr_in addr, std::string name = "__player__", float max_health = 100);
 
-    const std::vector<Control *> update(const tick_t current_tick, const TilemapDesc *map) override;
-    void rememberControl(Control &control);
+    // reuse a pooled player for a new peer
+    void reset(ID id, sockaddr_in addr, std::string name = "__player__", float max_health = 100);
+
+    void update(const tick_t current_tick, const TilemapDesc *map, ControlList &ctrls) override;
+    // `arrival_tick` is when its frame was received, -1 for a redundant copy
+    void rememberControl(Control &control, tick_t arrival_tick = -1);
+    // what the player is told it doesn't have to send again (see Controller::makeAck)
+    const PlayerController &getPlayerController() const { return player_controller; }
+    InputMetrics collectInputMetrics();
+
+    // plays again, movement and map collisions only, the ticks since the
+    // earliest one whose control arrived late, if they fit in `budget`
+    // ticks. Returns the number of ticks simulated.
+    int resimulate(const TilemapDesc *map, int budget);
 };
\ No newline at end of file
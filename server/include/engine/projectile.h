@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+
+#include "common/deftypes.h"
+#include "common/time.h"
+#include "engine/game_config.h"
+#include "engine/raycast.h"
+#include "engine/weapon.h"
+#include "network/network_frame.h"
+
+struct TilemapDesc;
+class Entity;
+
+enum ProjectileEventType : uint8_t
+{
+    PROJECTILE_SPAWN = 0,
+    PROJECTILE_IMPACT = 1,
+};
+
+// Sent to the clients in snapshots instead of one entity per bullet.
+// A spawn carries everything needed to simulate the bullet client-side,
+// an impact tells where and on what it stopped (target -1 for walls and
+// bullets that reached their range).
+struct ProjectileEvent
+{
+    ProjectileEventType type;
+    uint16_t id;
+    ID owner;  // spawn only
+    ID target; // impact only
+    float x;
+    float y;
+    float angle; // spawn only
+    float speed; // spawn only, in pixels/sec
+
+    const int write(NetworkFrame &frame) const;
+    const int size() const;
+};
+
+// Fixed capacity pool of bullets in flight, stored as arrays so that each
+// tick all of them are tested at once against the entities.
+// Live projectiles are kept packed in [0, count), a despawned projectile is
+// replaced by the last one.
+class Projectiles
+{
+    int count = 0;
+    uint16_t next_id = 0;
+
+    uint16_t id[MAX_PROJECTILES];
+    ID owner[MAX_PROJECTILES];
+    float x[MAX_PROJECTILES];
+    float y[MAX_PROJECTILES];
+    float angle[MAX_PROJECTILES];
+    float dir_x[MAX_PROJECTILES];
+    float dir_y[MAX_PROJECTILES];
+    float speed[MAX_PROJECTILES]; // in pixels/tick
+    float damage[MAX_PROJECTILES];
+    float remaining[MAX_PROJECTILES]; // distance left before reaching range
+
+    // scratch buffers, reserved once
+    RayBatch rays;
+    CircleBatch circles;
+    std::vector<Entity *> targets; // entity of each circle
+    std::vector<ID> owner_ids;      // owners of the projectiles, sorted, no duplicates
+    std::vector<int> owner_circles; // circle of each of owner_ids, -1 if not alive
+    std::vector<float> hit_dist;
+    std::vector<int> hit_index;
+    std::vector<float> wall_dist;
+
+    void despawn(int i, ID target, float x, float y, std::vector<ProjectileEvent> &events);
+
+public:
+    Projectiles();
+
+    int size() const { return count; }
+
+    // returns false if the pool is full (the bullet is dropped)
+    bool spawn(const Bullet &bullet, int bullet_speed, std::vector<ProjectileEvent> &events);
+
+    // move every projectile by one client tick, testing the swept segment
+    // against `entities` and the map
+    void update(const std::vector<Entity *> &entities, const TilemapDesc *map, std::vector<ProjectileEvent> &events);
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include "common/vector.hpp"
+
+// Circles stored as structure of arrays so that the hit kernel can load
+// several of them at once in SIMD registers.
+struct CircleBatch
+{
+    std::vector<float> x; // center
+    std::vector<float> y;
+    std::vector<float> radius;
+
+    void clear();
+    void reserve(const int n);
+    void push(const Vec2f center, const float radius);
+
+    int size() const { return (int)x.size(); }
+};
+
+// Rays given by their origin and a unit direction (no angle, cos/sin are
+// computed once by the caller).
+struct RayBatch
+{
+    std::vector<float> x; // origin
+    std::vector<float> y;
+    std::vector<float> dir_x; // unit direction
+    std::vector<float> dir_y;
+    std::vector<float> range;
+    std::vector<int> skip; // index of a circle to ignore (eg. the shooter), -1 if none
+
+    void clear();
+    void reserve(const int n);
+    void push(const Vec2f origin, const Vec2f dir, const float range, const int skip = -1);
+
+    int size() const { return (int)x.size(); }
+};
+
+// For each ray, finds the closest circle it hits in (0, range].
+// `out_dist[i]` receives the distance to the hit (-1 if none) and `out_index[i]`
+// the index of the circle in `circles` (-1 if none).
+// Uses AVX2 or SSE2 when available at compile time, scalar code otherwise.
+void computeClosestHits(const RayBatch &rays, const CircleBatch &circles, float *out_dist, int *out_index);
+
+// same as above but always runs the scalar code, kept to check the SIMD paths
+void computeClosestHitsScalar(const RayBatch &rays, const CircleBatch &circles, float *out_dist, int *out_index);
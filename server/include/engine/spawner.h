@@ -1,10 +1,78 @@
 #pragma once
 
-#include "engine/entity.h"
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "common/pool.hpp"
+#include "common/time.h"
+#include "engine/enemy.h"
+
+class World;
+class Map;
+class AI;
+
+enum SlotState : uint8_t
+{
+    SLOT_WAITING_WAVE = 0, // not spawned yet
+    SLOT_ALIVE = 1,
+    SLOT_RESPAWNING = 2,
+    SLOT_DONE = 3, // dead, won't respawn
+};
+
+// One NPC to spawn. Slots of a group are contiguous.
+struct SpawnSlot
+{
+    int group;
+    int enemy; // index in the group
+    Vec2f pos;
+    SlotState state;
+    tick_t respawn_tick;
+    NPC *npc;
+};
+
+struct GroupState
+{
+    int first_slot;
+    int end_slot;
+    int next_slot; // next slot waiting for its wave
+    tick_t next_wave_tick;
+};
+
+// Turns the enemy groups of a map into NPCs, in waves, and respawns them
+// when they die. NPCs are preallocated in a pool sized to the number of
+// slots, so spawning and respawning never allocates.
 class EntitySpawner
 {
+    World *world;
+    Map *map;
+    std::shared_ptr<AI> ai; // for enemies without a behavior, or with an unknown one
+    std::vector<std::pair<std::string, std::shared_ptr<AI>>> behavior_ais;
+
+    std::vector<SpawnSlot> slots;
+    std::vector<GroupState> groups;
+    std::unique_ptr<Pool<NPC>> npcs;
+
+    int n_alive = 0;
+
+    Vec2f findSpawnPosition(const Enemy &enemy, Random &random) const;
+    std::shared_ptr<AI> getAI(const Enemy &enemy) const;
+
+    // false if the pool is empty, the slot is left as it was
+    bool spawn(int slot);
+    void despawn(int slot, tick_t current_tick);
 
 public:
-    EntitySpawner();
-}
\ No newline at end of file
+    EntitySpawner(World *world, Map *map, std::shared_ptr<AI> ai);
+
+    // AI of the enemies whose `behavior` property is `behavior`
+    void setAI(const std::string &behavior, std::shared_ptr<AI> ai);
+
+    void update(tick_t current_tick);
+
+    bool owns(const Entity *entity) const;
+
+    int getNSlots() const { return (int)slots.size(); }
+    int getNAlive() const { return n_alive; }
+};
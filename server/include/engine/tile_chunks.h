@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "engine/collision_map.h"
+
+typedef uint32_t TILE;
+
+// The tiles of a map, stored by chunks of CHUNK_SIZE * CHUNK_SIZE tiles.
+// A chunk where every tile is the same only stores that tile, the others have
+// a page of their own, so large maps don't need one contiguous allocation and
+// uniform areas (eg. outside of the playable part) cost almost nothing.
+// Pages can also be borrowed (eg. from a cooked map mapped in memory).
+class TileChunks
+{
+    struct Chunk
+    {
+        TILE *page;   // CHUNK_SIZE * CHUNK_SIZE tiles, nullptr if uniform
+        TILE uniform; // every tile of the chunk if there is no page
+        bool owned;   // page allocated by us
+    };
+
+    int width;
+    int height;
+    int chunks_x;
+    int chunks_y;
+    std::vector<Chunk> chunks;
+
+    Chunk &chunkOf(const int x, const int y) { return chunks[(size_t)(y >> CHUNK_SHIFT) * chunks_x + (x >> CHUNK_SHIFT)]; }
+    const Chunk &chunkOf(const int x, const int y) const { return chunks[(size_t)(y >> CHUNK_SHIFT) * chunks_x + (x >> CHUNK_SHIFT)]; }
+    void freePage(Chunk &chunk);
+
+public:
+    // every tile set to `tile`
+    TileChunks(const int width, const int height, const TILE tile = 0);
+    TileChunks(const TileChunks &) = delete;
+    ~TileChunks();
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getChunksX() const { return chunks_x; }
+    int getChunksY() const { return chunks_y; }
+
+    // (x, y) must be in the map
+    TILE get(const int x, const int y) const
+    {
+        const Chunk &chunk = chunkOf(x, y);
+        if (!chunk.page)
+            return chunk.uniform;
+        return chunk.page[((y & (CHUNK_SIZE - 1)) << CHUNK_SHIFT) + (x & (CHUNK_SIZE - 1))];
+    }
+    void set(const int x, const int y, const TILE tile);
+    void fill(const TILE tile);
+
+    // drops the pages of chunks that ended up uniform (eg. after loading)
+    void compact();
+    int getNPages() const;
+
+    // copies `n` tiles of row y starting at x into `out`
+    void copyRow(const int x, const int y, const int n, TILE *out) const;
+
+    // direct access to a chunk, by chunk coordinates
+    const TILE *getPage(const int cx, const int cy) const { return chunks[(size_t)cy * chunks_x + cx].page; }
+    TILE getUniform(const int cx, const int cy) const { return chunks[(size_t)cy * chunks_x + cx].uniform; }
+    void setUniform(const int cx, const int cy, const TILE tile);
+    void borrowPage(const int cx, const int cy, TILE *page);
+};
@@ -5,12 +5,14 @@
 
 #include "common/vector.hpp"
 #include "common/bitarray.h"
+#include "common/mapped_file.h"
+#include "engine/collision_map.h"
+#include "engine/distance_field.h"
+#include "engine/tile_chunks.h"
 #include "network/network.h"
 #include "engine/enemy.h"
 #include "engine/world.h"
 
-typedef uint32_t TILE;
-
 struct TilesetDesc
 {
     int width;
@@ -30,8 +32,9 @@ struct TilemapDesc
     int height;
     uint8_t tile_size;
     uint8_t scale;
-    TILE *tiles;
-    BitArray *collisions;
+    TileChunks *tiles;
+    CollisionMap *collisions; // summarized, see CollisionMap::summarize
+    DistanceField *clearance; // built from collisions
 
     const Vec2i xyOfIndex(const int i) const;
     int indexOfXY(const int x, const int y) const;
@@ -48,6 +51,10 @@ struct TilemapDesc
     const bool getSolid(const int x, const int y) const;
     const bool getSolid(const Vec2i xy) const;
 
+    // distance in tiles to the closest solid tile (0 if solid), see DistanceField
+    const uint8_t getClearance(const int x, const int y) const;
+    const uint8_t getClearance(const Vec2f pos) const; // at a world position
+
     void fill(const TILE tile);
     // set n first-last lines-cols
     void setBorder(const int n, const TILE tile);
@@ -63,7 +70,11 @@ struct Group
     std::vector<T> elts;
 };
 
-struct Enemy;
+struct EnemyGroup : Group<Enemy>
+{
+    WaveRules rules;
+};
+
 struct SpawnPoint;
 
 class Map
@@ -73,13 +84,17 @@ class Map
     TilemapDesc tilemap;
     TilesetDesc tileset;
 
+    // backs tiles, collisions, clearance and the tileset image of a cooked map
+    MappedFile file;
+
     void loadLayer(tinyxml2::XMLElement *layer);
     void loadEnemies(tinyxml2::XMLElement *layer);
     void loadSpawns(tinyxml2::XMLElement *layer);
     bool loadTileset(const char *path);
+    bool loadCooked(const char *path); // see cooked_map.h
 
 public:
-    std::vector<Group<Enemy>> enemy_groups;
+    std::vector<EnemyGroup> enemy_groups;
     std::vector<Group<SpawnPoint>> spawn_points;
 
     Map(int scale);
@@ -87,5 +102,8 @@ public:
     const TilemapDesc *getTilemap() { return &tilemap; }
     const TilesetDesc *getTileset() { return &tileset; }
 
+    // Tiled XML map, or a cooked map if the path ends with ".cmap"
     bool load(const char *path);
+    // writes what has been loaded as a cooked map (see cooked_map.h)
+    bool cook(const char *path) const;
 };
\ No newline at end of file
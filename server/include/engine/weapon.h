@@ -9,6 +9,7 @@ struct Bullet
     ID owner;
     Vec2f pos;
     float angle;
+    Vec2f dir; // (cos(angle), sin(angle)), computed once when the bullet is fired
     float damage;
     int range;
 };
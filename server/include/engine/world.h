@@ -3,10 +3,18 @@
 #include <windows.h>
 #include <vector>
 #include <deque>
+#include <memory>
 
 #include "common/deftypes.h"
+#include "common/pool.hpp"
+#include "engine/ai_scheduler.h"
 #include "engine/game_config.h"
+#include "engine/pathfinder.h"
+#include "engine/perception.h"
 #include "engine/player.h"
+#include "engine/projectile.h"
+#include "engine/raycast.h"
+#include "engine/spawner.h"
 
 class Map;
 
@@ -17,6 +25,9 @@ struct Snapshot
     tick_t tick;
     std::vector<EntityDesc> entities;
     std::vector<ID> despawned_entities;
+    // events since the previous snapshot, in a buffer of the World reused by
+    // its next makeSnapshot (nullptr in the history, they were sent)
+    const std::vector<ProjectileEvent> *projectile_events = nullptr;
 
     const int write(NetworkFrame &frame, const Player *player, const TilemapDesc *TilemapDesc = nullptr) const;
     const int size() const;
@@ -34,7 +45,11 @@ struct WorldConfig
     const int size() const;
 };
 
-// A control + extra information, this is what the server receives
+// A control + extra information, this is what the server receives.
+// The control of the frame can be followed by a count and that many earlier
+// controls, each with its tick as a one byte offset back from the frame's,
+// so that a control lost with its packet comes again in the next ones.
+// Frames without them (15 bytes) are still read.
 struct ControlFrame
 {
     tick_t reception_server_tick;
@@ -44,6 +59,9 @@ struct ControlFrame
     ID last_snapshot;
     char ack[ACK_SIZE];
     Control control;
+    Control redundant[MAX_REDUNDANT_CONTROLS]; // newest first
+    int n_redundant = 0;
+    bool valid = false; // false if the frame was too short
 
     static ControlFrame read(NetworkFrame frame);
 };
@@ -61,29 +79,73 @@ class World
 
     Map *map;
 
+    // players are taken from a pool so that joins and leaves don't allocate
+    Pool<Player> player_pool;
     std::vector<Player *> players;
     std::vector<Entity *> entities;
-    std::vector<ID> dropped_players;
+    std::vector<ID> dropped_players; // despawned players and entities since last snapshot
+
+    // spawns NPCs from the map enemy groups, if any
+    std::unique_ptr<EntitySpawner> spawner;
+
+    // flow fields towards the players, for the AIs
+    Pathfinder pathfinder;
+    // what NPCs see, then when they think
+    Perception perception;
+    AIScheduler ai_scheduler;
+
+    // scratch buffers for hitscan, kept between calls to avoid reallocations
+    std::vector<Bullet> bullets;
+    RayBatch hitscan_rays;
+    CircleBatch hitscan_circles;
+    std::vector<float> hitscan_dist;
+    std::vector<int> hitscan_index;
+    std::vector<float> hitscan_wall_dist;
+    std::vector<ID> hitscan_ids; // of the circles
+
+    // bullets with a speed
+    Projectiles projectiles;
+    std::vector<Entity *> projectile_targets;
+    std::vector<ProjectileEvent> projectile_events; // since last snapshot
+    std::vector<ProjectileEvent> snapshot_events;   // of the last snapshot
 
     int getPlayerIndexById(const ID id) const;
+    // fires the equipped weapon of `shooter`, hitscans are resolved against
+    // the world as seen at `seen_tick`
+    void shoot(Entity *shooter, tick_t seen_tick, tick_t current_tick);
+    // latest snapshot made at or before `tick` (the oldest one if they are
+    // all newer), nullptr if none was remembered
     const Snapshot *getSnapshotAtTick(tick_t tick) const;
 
 public:
     World(Map *map);
     ~World();
 
+    // returns nullptr if the world is full
     Player *createPlayer(ID id, sockaddr_in from, std::string name);
     void dropPlayer(const ID id);
 
     void add(Entity *entity);
     void add(Player *entity);
+    void add(NPC *npc); // its AI is run by the world AIScheduler
+    // removes a (non player) entity without deleting it
+    void remove(Entity *entity);
+
+    void setSpawner(std::unique_ptr<EntitySpawner> spawner);
+    Pathfinder *getPathfinder() { return &pathfinder; }
+    const Pathfinder *getPathfinder() const { return &pathfinder; }
+    AIScheduler *getAIScheduler() { return &ai_scheduler; }
+    InputMetrics collectInputMetrics(); // of all the players
 
     void update(tick_t current_tick);
-    void doHitScan(Bullet bullet, tick_t tick);
+    // resolve all `bullets` (eg. the pellets of a single shot) against the
+    // snapshot at `tick` in one batch
+    void doHitScan(const std::vector<Bullet> &bullets, tick_t tick);
 
     const int getNPlayers() const;
     const std::vector<Player *> &getPlayers() const;
     const int getNEntities() const;
+    const int getNProjectiles() const;
 
     Snapshot makeSnapshot(tick_t current_tick);
     WorldConfig makeConfig(Snapshot *snapshot);
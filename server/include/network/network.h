@@ -1,10 +1,12 @@
 #pragma once
 
 #include <windows.h>
+#include <mutex>
 #include <vector>
 #include <queue>
 
 #include "common/deftypes.h"
+#include "common/time.h"
 #include "network_frame.h"
 
 #ifndef MAX_PEERS
@@ -40,6 +42,9 @@ protected:
     SOCKET sock;
     sockaddr_in addr;
 
+    // peers are read by the match threads when they send frames
+    mutable std::recursive_mutex peers_mutex;
+
     Peer peers[MAX_PEERS];
     unsigned long long last_com_date[MAX_PEERS]; // in ms
     bool alive[MAX_PEERS] = {false};
@@ -71,8 +76,8 @@ public:
 
     bool isOpen() const { return server_open; };
 
-    // timeout in ms
-    virtual int update(unsigned long long timeout);
+    // waits at most `timeout` for frames
+    virtual int update(Duration timeout);
 
     virtual int sendTo(ID id, const NetworkFrame &frame);
 
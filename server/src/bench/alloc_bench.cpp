@@ -0,0 +1,158 @@
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include "loguru/loguru.hpp"
+
+#include "common/time.h"
+#include "engine/ai.h"
+#include "engine/behavior.h"
+#include "engine/controller.h"
+#include "engine/game_config.h"
+#include "engine/player.h"
+#include "engine/spawner.h"
+#include "engine/tilemap.h"
+#include "engine/weapon.h"
+#include "engine/world.h"
+
+// Counts the heap allocations of the simulation step:
+//   alloc_bench [map.xml|map.cmap] [--ticks N]
+// a world on the map (data/second_try.xml by default, run from the server
+// directory) with one player sending a control per tick, stepped like a match
+// does: World::update every client tick, then makeSnapshot and remember on
+// every server tick. The calls to operator new made by the player's
+// Entity::update and by World::update must be 0 once the world is warmed up,
+// those of the snapshots (which copy the entities) are only reported.
+
+#define WARMUP_TICKS 120
+
+// every allocation of the process goes through these, the AI threads too
+static std::atomic<long> n_allocations(0);
+
+void *operator new(size_t size)
+{
+    n_allocations++;
+    void *p = malloc(size > 0 ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+static void sendControl(Player *player, tick_t tick, uint8_t movement)
+{
+    Control control;
+    memset(&control, 0, sizeof(control));
+    control.tick = tick;
+    control.movement = movement;
+    player->rememberControl(control, tick);
+}
+
+// same as Match::run, at the end of the client tick `tick`
+static bool isServerTick(tick_t tick)
+{
+    return (int64_t)tick * SERVER_RATE / CLIENT_RATE > (int64_t)(tick - 1) * SERVER_RATE / CLIENT_RATE;
+}
+
+int main(int argc, char **argv)
+{
+    loguru::init(argc, argv);
+    Time::startNow();
+
+    const char *map_path = "data/second_try.xml";
+    int n_ticks = 600;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc)
+            n_ticks = atoi(argv[++i]);
+        else
+            map_path = argv[i];
+    }
+    if (n_ticks <= 0)
+    {
+        LOG_F(ERROR, "usage: %s [map.xml|map.cmap] [--ticks N]", argv[0]);
+        return 1;
+    }
+
+    Weapons::loadFromFile("data/weapons.xml");
+    Behaviors::loadFromFile("data/behaviors.xml");
+
+    Map map(4);
+    if (!map.load(map_path))
+    {
+        LOG_F(ERROR, "could not load map %s", map_path);
+        return 1;
+    }
+
+    // set up like a match of the server
+    World world(&map);
+    std::unique_ptr<EntitySpawner> spawner = std::make_unique<EntitySpawner>(&world, &map, std::make_shared<Chase>(&world));
+    for (int b = 0; b < Behaviors::nBehaviors(); b++)
+    {
+        const BehaviorTree *tree = Behaviors::get(b);
+        spawner->setAI(tree->name, std::make_shared<BehaviorAI>(&world, tree));
+    }
+    world.setSpawner(std::move(spawner));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    Player *player = world.createPlayer(1, addr, "bench");
+    if (!player)
+        return 1;
+
+    // the initial snapshot of a match, hitscans rewind to the snapshots
+    world.remember(world.makeSnapshot(0));
+
+    // pools, scratch buffers and histories reach their size
+    tick_t tick = 1;
+    for (; tick <= WARMUP_TICKS; tick++)
+    {
+        sendControl(player, tick, tick % 2 ? MOVE_LEFT : MOVE_RIGHT);
+        world.update(tick);
+        if (isServerTick(tick))
+            world.remember(world.makeSnapshot(tick));
+    }
+
+    // the player is stepped on its own first, so the world doesn't find its
+    // control again
+    ControlList controls;
+    long player_allocations = 0;
+    long world_allocations = 0;
+    long snapshot_allocations = 0;
+    int n_snapshots = 0;
+    int n_applied = 0;
+    for (int i = 0; i < n_ticks; i++, tick++)
+    {
+        sendControl(player, tick, i % 2 ? MOVE_UP : MOVE_DOWN);
+
+        long before = n_allocations;
+        player->update(tick, map.getTilemap(), controls);
+        player_allocations += n_allocations - before;
+        n_applied += controls.size();
+
+        before = n_allocations;
+        world.update(tick);
+        world_allocations += n_allocations - before;
+
+        if (isServerTick(tick))
+        {
+            before = n_allocations;
+            world.remember(world.makeSnapshot(tick));
+            snapshot_allocations += n_allocations - before;
+            n_snapshots++;
+        }
+    }
+
+    LOG_F(INFO, "%d ticks, %d entities", n_ticks, world.getNEntities());
+    LOG_F(INFO, "Entity::update of the player  %ld allocations (%d controls applied)", player_allocations, n_applied);
+    LOG_F(INFO, "World::update                 %ld allocations", world_allocations);
+    LOG_F(INFO, "makeSnapshot + remember       %ld allocations (%d snapshots, not counted)", snapshot_allocations, n_snapshots);
+
+    return player_allocations == 0 && world_allocations == 0 ? 0 : 1;
+}
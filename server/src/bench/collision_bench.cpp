@@ -0,0 +1,207 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "loguru/loguru.hpp"
+
+#include "common/time.h"
+#include "engine/collision.h"
+#include "engine/collision_map.h"
+#include "engine/tilemap.h"
+
+// Times sweepBox against the two-corner check it replaced:
+//   collision_bench [--moves N] [--controls K] [--reps N]
+// each move is the tick of an entity applying K controls, resolved by the old
+// path after every control and by one sweep for the whole tick. The sweep
+// must never leave a box overlapping a wall, nor differ from the scan its
+// fast path skips.
+
+#define MAP_SIZE 256 // in tiles
+#define N_WALLS 1200
+#define BOX_SIZE 18.0f // entity of radius 9
+#define MAX_STEP 5.0f  // max_velocity of an entity, per control
+
+// Entity::doMapCollisions before the swept box: only the tiles under the top
+// left and bottom right corners are looked at
+static Vec2f resolveOld(Vec2f pos, Vec2f last_pos, const TilemapDesc *map)
+{
+    const int tile_size = map->tile_size * map->scale;
+    const Vec2f size(BOX_SIZE, BOX_SIZE);
+    const Vec2f tile(tile_size, tile_size);
+
+    Vec2i corner = map->xyOfWorldPos(pos);
+    if (map->getSolid(corner))
+    {
+        Vec2f pos_tile = map->worldPosOfXY(corner);
+        pos.x -= computeOverlapX(pos, last_pos, size, pos_tile, pos_tile, tile);
+        pos.y -= computeOverlapY(pos, last_pos, size, pos_tile, pos_tile, tile);
+    }
+
+    corner = map->xyOfWorldPos(pos + size);
+    if (map->getSolid(corner))
+    {
+        Vec2f pos_tile = map->worldPosOfXY(corner);
+        pos.x -= computeOverlapX(pos, last_pos, size, pos_tile, pos_tile, tile);
+        pos.y -= computeOverlapY(pos, last_pos, size, pos_tile, pos_tile, tile);
+    }
+    return pos;
+}
+
+static bool overlapsWall(Vec2f pos, const TilemapDesc *map)
+{
+    const float tile_size = (float)(map->tile_size * map->scale);
+    int left = (int)floorf(pos.x / tile_size);
+    int top = (int)floorf(pos.y / tile_size);
+    int right = (int)floorf((pos.x + BOX_SIZE - 0.01f) / tile_size);
+    int bottom = (int)floorf((pos.y + BOX_SIZE - 0.01f) / tile_size);
+    for (int y = top; y <= bottom; y++)
+    {
+        for (int x = left; x <= right; x++)
+        {
+            if (map->getSolid(x, y))
+                return true;
+        }
+    }
+    return false;
+}
+
+// times `run` once, in microseconds
+template <typename F>
+static double timeRun(F run)
+{
+    TimePoint start = Time::nowPoint();
+    run();
+    return (double)(Time::nowPoint() - start).ns / 1000.0;
+}
+
+static float randomStep()
+{
+    return (float)(rand() % 2001 - 1000) / 1000.0f * MAX_STEP;
+}
+
+int main(int argc, char **argv)
+{
+    loguru::init(argc, argv);
+    Time::startNow();
+
+    int n_moves = 1000000;
+    int n_controls = 1;
+    int reps = 10;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--moves") == 0)
+            n_moves = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--controls") == 0)
+            n_controls = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--reps") == 0)
+            reps = atoi(argv[++i]);
+    }
+    if (n_moves <= 0 || n_controls <= 0 || reps <= 0)
+    {
+        LOG_F(ERROR, "usage: %s [--moves N] [--controls K] [--reps N]", argv[0]);
+        return 1;
+    }
+
+    // walls of 3 to 17 tiles, like the ones of a level
+    srand(1);
+    CollisionMap collisions(MAP_SIZE, MAP_SIZE);
+    for (int k = 0; k < N_WALLS; k++)
+    {
+        int x = rand() % MAP_SIZE;
+        int y = rand() % MAP_SIZE;
+        int length = 3 + rand() % 15;
+        bool horizontal = rand() % 2;
+        for (int j = 0; j < length; j++)
+        {
+            int tx = horizontal ? x + j : x;
+            int ty = horizontal ? y : y + j;
+            if (tx < MAP_SIZE && ty < MAP_SIZE)
+                collisions.set(tx, ty);
+        }
+    }
+    collisions.summarize();
+
+    TilemapDesc map;
+    map.width = MAP_SIZE;
+    map.height = MAP_SIZE;
+    map.tile_size = 8;
+    map.scale = 4;
+    map.tiles = nullptr;
+    map.collisions = &collisions;
+    map.clearance = nullptr;
+
+    // entities start clear of the walls
+    const float map_size = (float)(MAP_SIZE * map.tile_size * map.scale);
+    std::vector<Vec2f> starts;
+    std::vector<Vec2f> steps;
+    starts.reserve(n_moves);
+    steps.reserve((size_t)n_moves * n_controls);
+    while ((int)starts.size() < n_moves)
+    {
+        Vec2f pos((float)(rand() % (int)(map_size - BOX_SIZE)), (float)(rand() % (int)(map_size - BOX_SIZE)));
+        if (overlapsWall(pos, &map))
+            continue;
+
+        starts.push_back(pos);
+        for (int c = 0; c < n_controls; c++)
+            steps.push_back(Vec2f(randomStep(), randomStep()));
+    }
+
+    std::vector<Vec2f> old_ends(n_moves), sweep_ends(n_moves);
+
+    auto run_old = [&]() {
+        for (int i = 0; i < n_moves; i++)
+        {
+            Vec2f pos = starts[i];
+            for (int c = 0; c < n_controls; c++)
+            {
+                Vec2f last_pos = pos;
+                pos = resolveOld(pos + steps[(size_t)i * n_controls + c], last_pos, &map);
+            }
+            old_ends[i] = pos;
+        }
+    };
+    auto run_sweep = [&]() {
+        for (int i = 0; i < n_moves; i++)
+        {
+            Vec2f delta(0, 0);
+            for (int c = 0; c < n_controls; c++)
+                delta = delta + steps[(size_t)i * n_controls + c];
+            sweep_ends[i] = sweepBox(starts[i], Vec2f(BOX_SIZE, BOX_SIZE), delta, &map);
+        }
+    };
+
+    // interleaved so that both see the same noise, best of `reps`
+    double old_us = 0;
+    double sweep_us = 0;
+    for (int r = 0; r < reps; r++)
+    {
+        double us = timeRun(run_old);
+        old_us = r == 0 || us < old_us ? us : old_us;
+        us = timeRun(run_sweep);
+        sweep_us = r == 0 || us < sweep_us ? us : sweep_us;
+    }
+
+    int old_in_walls = 0;
+    int sweep_in_walls = 0;
+    int mismatches = 0;
+    for (int i = 0; i < n_moves; i++)
+    {
+        old_in_walls += overlapsWall(old_ends[i], &map);
+        sweep_in_walls += overlapsWall(sweep_ends[i], &map);
+
+        Vec2f delta(0, 0);
+        for (int c = 0; c < n_controls; c++)
+            delta = delta + steps[(size_t)i * n_controls + c];
+        Vec2f scanned = sweepBoxScan(starts[i], Vec2f(BOX_SIZE, BOX_SIZE), delta, &map);
+        mismatches += scanned.x != sweep_ends[i].x || scanned.y != sweep_ends[i].y;
+    }
+
+    LOG_F(INFO, "%d moves of %d controls, best of %d", n_moves, n_controls, reps);
+    LOG_F(INFO, "two corners  %7.1f ns per move, %d boxes left in a wall", old_us * 1000.0 / n_moves, old_in_walls);
+    LOG_F(INFO, "swept box    %7.1f ns per move (x%.2f), %d boxes left in a wall", sweep_us * 1000.0 / n_moves, old_us / sweep_us, sweep_in_walls);
+    if (mismatches > 0)
+        LOG_F(ERROR, "%d sweeps differ from sweepBoxScan", mismatches);
+
+    return sweep_in_walls == 0 && mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "loguru/loguru.hpp"
+
+#include "common/time.h"
+#include "engine/raycast.h"
+
+// Times the hitscan kernels against the per-entity loop they replaced:
+//   hitscan_bench [--circles N] [--rays N] [--reps N]
+// every ray is tested against every circle, like the pellets of a tick
+// against the entities of a world, and the three paths must agree
+
+#define ARENA_SIZE 4000
+#define CIRCLE_RADIUS 9.0f
+#define RAY_RANGE 1500.0f
+
+// the per-entity test before the batch kernels (Entity::computeDistance)
+static float computeDistanceOld(Vec2f ray_origin, float ray_angle, Vec2f sphere_origin, float sphere_radius)
+{
+    Vec2f dir = Vec2f((float)cos(ray_angle), (float)sin(ray_angle));
+    float t = (sphere_origin - ray_origin) * dir;
+    Vec2f p = ray_origin + t * dir;
+    float y = (float)sqrt((sphere_origin - p) * (sphere_origin - p));
+    if (y > sphere_radius)
+        return -1;
+
+    float x = (float)sqrt((double)sphere_radius * (double)sphere_radius - (double)y * (double)y);
+    return t - x;
+}
+
+static void closestHitsOld(const RayBatch &rays, const std::vector<float> &angles, const CircleBatch &circles, float *out_dist, int *out_index)
+{
+    for (int i = 0; i < rays.size(); i++)
+    {
+        Vec2f origin(rays.x[i], rays.y[i]);
+        out_dist[i] = -1;
+        out_index[i] = -1;
+        for (int j = 0; j < circles.size(); j++)
+        {
+            if (j == rays.skip[i])
+                continue;
+
+            float dist = computeDistanceOld(origin, angles[i], Vec2f(circles.x[j], circles.y[j]), circles.radius[j]);
+            if (dist > 0 && dist <= rays.range[i] && (out_index[i] < 0 || dist < out_dist[i]))
+            {
+                out_dist[i] = dist;
+                out_index[i] = j;
+            }
+        }
+    }
+}
+
+// best of `reps` runs, in microseconds
+template <typename F>
+static double timeBest(int reps, F run)
+{
+    Duration best = Duration::milliseconds(1000000);
+    for (int r = 0; r < reps; r++)
+    {
+        TimePoint start = Time::nowPoint();
+        run();
+        Duration took = Time::nowPoint() - start;
+        best = took < best ? took : best;
+    }
+    return (double)best.ns / 1000.0;
+}
+
+// true when ray i only touches circle j on its edge, where float rounding
+// decides between a hit and a miss and moves the hit a lot (-1 counts as
+// grazed)
+static bool isGrazed(const RayBatch &rays, int i, const CircleBatch &circles, int j)
+{
+    if (j < 0)
+        return true;
+
+    Vec2f to_center = Vec2f(circles.x[j], circles.y[j]) - Vec2f(rays.x[i], rays.y[i]);
+    float off_axis = fabsf(to_center.x * rays.dir_y[i] - to_center.y * rays.dir_x[i]);
+    return fabsf(off_axis - circles.radius[j]) < 0.05f;
+}
+
+// hit of ray i that float rounding can turn into a miss (or the other way
+// round): grazed circle, or ray starting on the edge of the circle
+static bool isBorderline(const RayBatch &rays, int i, const CircleBatch &circles, int j, float dist)
+{
+    return isGrazed(rays, i, circles, j) || dist < 1e-2f;
+}
+
+// same circle at the same distance up to float rounding (far hits differ by a
+// few hundredths of a pixel between the formulas), or the two paths only
+// disagree on a borderline hit
+static int countMismatches(const RayBatch &rays, const CircleBatch &circles, const float *dist_a, const int *index_a, const float *dist_b, const int *index_b)
+{
+    int mismatches = 0;
+    for (int i = 0; i < rays.size(); i++)
+    {
+        if (index_a[i] != index_b[i])
+        {
+            // the closer hit is the one only one of the paths saw
+            bool a_closer = index_b[i] < 0 || (index_a[i] >= 0 && dist_a[i] < dist_b[i]);
+            bool borderline = a_closer ? isBorderline(rays, i, circles, index_a[i], dist_a[i])
+                                       : isBorderline(rays, i, circles, index_b[i], dist_b[i]);
+            if (!borderline)
+                mismatches++;
+        }
+        else if (fabsf(dist_a[i] - dist_b[i]) > 1e-2f + dist_a[i] * 1e-4f && !isGrazed(rays, i, circles, index_a[i]))
+            mismatches++;
+    }
+    return mismatches;
+}
+
+int main(int argc, char **argv)
+{
+    loguru::init(argc, argv);
+    Time::startNow();
+
+    int n_circles = 500;
+    int n_rays = 1000;
+    int reps = 20;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--circles") == 0)
+            n_circles = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rays") == 0)
+            n_rays = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--reps") == 0)
+            reps = atoi(argv[++i]);
+    }
+    if (n_circles <= 0 || n_rays <= 0 || reps <= 0)
+    {
+        LOG_F(ERROR, "usage: %s [--circles N] [--rays N] [--reps N]", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    CircleBatch circles;
+    circles.reserve(n_circles);
+    for (int j = 0; j < n_circles; j++)
+        circles.push(Vec2f((float)(rand() % ARENA_SIZE), (float)(rand() % ARENA_SIZE)), CIRCLE_RADIUS);
+
+    // each ray is shot by one of the circles, which it must not hit
+    RayBatch rays;
+    std::vector<float> angles;
+    rays.reserve(n_rays);
+    angles.reserve(n_rays);
+    for (int i = 0; i < n_rays; i++)
+    {
+        int shooter = i % n_circles;
+        float angle = (float)(rand() % 6283) / 1000.0f;
+        angles.push_back(angle);
+        rays.push(Vec2f(circles.x[shooter], circles.y[shooter]), Vec2f(cosf(angle), sinf(angle)), RAY_RANGE, shooter);
+    }
+
+    std::vector<float> old_dist(n_rays), scalar_dist(n_rays), simd_dist(n_rays);
+    std::vector<int> old_index(n_rays), scalar_index(n_rays), simd_index(n_rays);
+
+    double old_us = timeBest(reps, [&]() { closestHitsOld(rays, angles, circles, old_dist.data(), old_index.data()); });
+    double scalar_us = timeBest(reps, [&]() { computeClosestHitsScalar(rays, circles, scalar_dist.data(), scalar_index.data()); });
+    double simd_us = timeBest(reps, [&]() { computeClosestHits(rays, circles, simd_dist.data(), simd_index.data()); });
+
+    int hits = 0;
+    for (int i = 0; i < n_rays; i++)
+        hits += old_index[i] >= 0;
+
+    int scalar_mismatches = countMismatches(rays, circles, old_dist.data(), old_index.data(), scalar_dist.data(), scalar_index.data());
+    int simd_mismatches = countMismatches(rays, circles, old_dist.data(), old_index.data(), simd_dist.data(), simd_index.data());
+
+    LOG_F(INFO, "%d rays x %d circles, %d hits, best of %d", n_rays, n_circles, hits, reps);
+    LOG_F(INFO, "per entity loop  %9.1f us", old_us);
+    LOG_F(INFO, "scalar kernel    %9.1f us (x%.1f), %d mismatches", scalar_us, old_us / scalar_us, scalar_mismatches);
+    LOG_F(INFO, "simd kernel      %9.1f us (x%.1f), %d mismatches", simd_us, old_us / simd_us, simd_mismatches);
+
+    return scalar_mismatches == 0 && simd_mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,218 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "loguru/loguru.hpp"
+
+#include "common/bitarray.h"
+#include "common/time.h"
+#include "engine/collision.h"
+#include "engine/collision_map.h"
+#include "engine/distance_field.h"
+#include "engine/raycast.h"
+#include "engine/tilemap.h"
+
+// Times the ray/map intersection against the DDA it replaced:
+//   ray_bench [--rays N] [--density D] [--reps N]
+// rays start from random empty tiles of a map where one tile out of D is
+// solid (6, 40 and 400 if D isn't given), and computeDistance,
+// computeDistances and the old DDA must agree
+
+#define MAP_WIDTH 256 // in tiles
+#define MAP_HEIGHT 200
+#define RAY_RANGE 3000.0f
+
+// computeDistance before the collision map: one tile per step, each read from
+// a byte-granular BitArray (the map has a solid border, it never reads out)
+static float computeDistanceOld(Vec2f ray_origin, float ray_angle, float range, const BitArray &solid, const TilemapDesc *map)
+{
+    int tile_size = map->tile_size * map->scale;
+
+    Vec2f pos = ray_origin / (float)tile_size;
+    Vec2i map_pos = Vec2i((int)pos.x, (int)pos.y);
+    Vec2f dir = Vec2f((float)cos(ray_angle), (float)sin(ray_angle));
+
+    float delta_dist_x = dir.y == 0 ? 0 : dir.x == 0 ? 1 : (float)fabs(1. / dir.x);
+    float delta_dist_y = dir.x == 0 ? 0 : dir.y == 0 ? 1 : (float)fabs(1. / dir.y);
+
+    int step_x = dir.x < 0 ? -1 : 1;
+    int step_y = dir.y < 0 ? -1 : 1;
+    float side_dist_x = dir.x < 0 ? (pos.x - map_pos.x) * delta_dist_x : (map_pos.x + 1 - pos.x) * delta_dist_x;
+    float side_dist_y = dir.y < 0 ? (pos.y - map_pos.y) * delta_dist_y : (map_pos.y + 1 - pos.y) * delta_dist_y;
+
+    bool hit = false;
+    float wall_dist = 0;
+    while (!hit)
+    {
+        int side;
+        if (side_dist_x < side_dist_y)
+        {
+            side_dist_x += delta_dist_x;
+            map_pos.x += step_x;
+            side = 0;
+        }
+        else
+        {
+            side_dist_y += delta_dist_y;
+            map_pos.y += step_y;
+            side = 1;
+        }
+
+        hit = solid.get(map->indexOfXY(map_pos.x, map_pos.y));
+
+        if (side == 0)
+            wall_dist = (map_pos.x - pos.x + (1 - step_x) / 2) / dir.x;
+        else
+            wall_dist = (map_pos.y - pos.y + (1 - step_y) / 2) / dir.y;
+
+        if (wall_dist > range / tile_size)
+            return range;
+    }
+
+    return wall_dist * tile_size;
+}
+
+// best of `reps` runs, in microseconds
+template <typename F>
+static double timeBest(int reps, F run)
+{
+    Duration best = Duration::milliseconds(1000000);
+    for (int r = 0; r < reps; r++)
+    {
+        TimePoint start = Time::nowPoint();
+        run();
+        Duration took = Time::nowPoint() - start;
+        best = took < best ? took : best;
+    }
+    return (double)best.ns / 1000.0;
+}
+
+// true if the ray goes through the corner of a tile at `dist`: which of the
+// tiles around it the ray enters is down to float rounding
+static bool isOnCorner(const RayBatch &rays, int i, float dist, float tile_size)
+{
+    float x = (rays.x[i] + dist * rays.dir_x[i]) / tile_size;
+    float y = (rays.y[i] + dist * rays.dir_y[i]) / tile_size;
+    return fabsf(x - roundf(x)) < 1e-3f && fabsf(y - roundf(y)) < 1e-3f;
+}
+
+// same wall up to float rounding (the old DDA works from the angle, the new
+// code from the direction vector), or the two paths only disagree on a wall
+// the closer one clipped on its corner
+static int countMismatches(const RayBatch &rays, const std::vector<float> &dist_a, const std::vector<float> &dist_b, float tile_size)
+{
+    int mismatches = 0;
+    for (int i = 0; i < rays.size(); i++)
+    {
+        float closer = dist_a[i] < dist_b[i] ? dist_a[i] : dist_b[i];
+        if (fabsf(dist_a[i] - dist_b[i]) > 0.05f && !isOnCorner(rays, i, closer, tile_size))
+            mismatches++;
+    }
+    return mismatches;
+}
+
+// runs the three paths on one map, returns the number of mismatches
+static int runDensity(int density, int n_rays, int reps)
+{
+    srand(density);
+    CollisionMap collisions(MAP_WIDTH, MAP_HEIGHT);
+    BitArray solid(MAP_WIDTH * MAP_HEIGHT);
+    TilemapDesc map;
+    map.width = MAP_WIDTH;
+    map.height = MAP_HEIGHT;
+    map.tile_size = 8;
+    map.scale = 4;
+    map.tiles = nullptr;
+    map.collisions = &collisions;
+
+    for (int y = 0; y < MAP_HEIGHT; y++)
+    {
+        for (int x = 0; x < MAP_WIDTH; x++)
+        {
+            bool border = x == 0 || y == 0 || x == MAP_WIDTH - 1 || y == MAP_HEIGHT - 1;
+            if (border || rand() % density == 0)
+            {
+                collisions.set(x, y);
+                solid.set(map.indexOfXY(x, y));
+            }
+        }
+    }
+    collisions.summarize();
+    DistanceField clearance;
+    clearance.build(collisions);
+    map.clearance = &clearance;
+
+    const int tile_size = map.tile_size * map.scale;
+    RayBatch rays;
+    std::vector<float> angles;
+    rays.reserve(n_rays);
+    angles.reserve(n_rays);
+    while (rays.size() < n_rays)
+    {
+        Vec2f origin((float)(rand() % (MAP_WIDTH * tile_size)), (float)(rand() % (MAP_HEIGHT * tile_size)));
+        if (collisions.get((int)origin.x / tile_size, (int)origin.y / tile_size))
+            continue;
+
+        float angle = (float)(rand() % 6283) / 1000.0f;
+        angles.push_back(angle);
+        rays.push(origin, Vec2f(cosf(angle), sinf(angle)), RAY_RANGE);
+    }
+
+    std::vector<float> old_dist(n_rays), angle_dist(n_rays), batch_dist(n_rays);
+    double old_us = timeBest(reps, [&]() {
+        for (int i = 0; i < n_rays; i++)
+            old_dist[i] = computeDistanceOld(Vec2f(rays.x[i], rays.y[i]), angles[i], RAY_RANGE, solid, &map);
+    });
+    double angle_us = timeBest(reps, [&]() {
+        for (int i = 0; i < n_rays; i++)
+            angle_dist[i] = computeDistance(Vec2f(rays.x[i], rays.y[i]), angles[i], RAY_RANGE, &map);
+    });
+    double batch_us = timeBest(reps, [&]() { computeDistances(rays, &map, batch_dist.data()); });
+
+    int angle_mismatches = countMismatches(rays, old_dist, angle_dist, (float)tile_size);
+    int batch_mismatches = countMismatches(rays, old_dist, batch_dist, (float)tile_size);
+
+    LOG_F(INFO, "1 tile out of %d solid, %d rays, best of %d", density, n_rays, reps);
+    LOG_F(INFO, "old dda           %6.2f Mrays/s", n_rays / old_us);
+    LOG_F(INFO, "computeDistance   %6.2f Mrays/s (x%.2f), %d mismatches", n_rays / angle_us, old_us / angle_us, angle_mismatches);
+    LOG_F(INFO, "computeDistances  %6.2f Mrays/s (x%.2f), %d mismatches", n_rays / batch_us, old_us / batch_us, batch_mismatches);
+
+    return angle_mismatches + batch_mismatches;
+}
+
+int main(int argc, char **argv)
+{
+    loguru::init(argc, argv);
+    Time::startNow();
+
+    int n_rays = 200000;
+    int density = 0;
+    int reps = 5;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--rays") == 0)
+            n_rays = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--density") == 0)
+            density = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--reps") == 0)
+            reps = atoi(argv[++i]);
+    }
+    if (n_rays <= 0 || density < 0 || density == 1 || reps <= 0)
+    {
+        LOG_F(ERROR, "usage: %s [--rays N] [--density D] [--reps N]", argv[0]);
+        return 1;
+    }
+
+    int mismatches = 0;
+    if (density > 0)
+        mismatches += runDensity(density, n_rays, reps);
+    else
+    {
+        // dense rooms, a level, open fields
+        mismatches += runDensity(6, n_rays, reps);
+        mismatches += runDensity(40, n_rays, reps);
+        mismatches += runDensity(400, n_rays, reps);
+    }
+
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+#include "common/histogram.h"
+
+#include <cstring>
+
+#include "common/bits.h"
+
+Histogram::Histogram()
+{
+    reset();
+}
+
+int Histogram::bucketOf(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+        return (int)value;
+
+    int shift = highestBit64(value) - HISTOGRAM_SUB_BITS;
+    return (shift + 1) * SUB_BUCKETS + (int)((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+uint64_t Histogram::highestOf(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+
+    int shift = bucket / SUB_BUCKETS - 1;
+    uint64_t lowest = (uint64_t)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    return lowest + ((uint64_t)1 << shift) - 1;
+}
+
+void Histogram::record(uint64_t value)
+{
+    counts[bucketOf(value)]++;
+    total++;
+    sum += value;
+    if (value < min_value)
+        min_value = value;
+    if (value > max_value)
+        max_value = value;
+}
+
+void Histogram::merge(const Histogram &other)
+{
+    for (int i = 0; i < N_BUCKETS; i++)
+        counts[i] += other.counts[i];
+    total += other.total;
+    sum += other.sum;
+    if (other.min_value < min_value)
+        min_value = other.min_value;
+    if (other.max_value > max_value)
+        max_value = other.max_value;
+}
+
+void Histogram::reset()
+{
+    memset(counts, 0, sizeof(counts));
+    total = 0;
+    sum = 0;
+    min_value = UINT64_MAX;
+    max_value = 0;
+}
+
+double Histogram::mean() const
+{
+    return total > 0 ? (double)sum / total : 0;
+}
+
+uint64_t Histogram::percentile(double p) const
+{
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(p / 100.0 * total + 0.5);
+    if (rank < 1)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < N_BUCKETS; i++)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+        {
+            uint64_t highest = highestOf(i);
+            return highest < max_value ? highest : max_value;
+        }
+    }
+
+    return max_value;
+}
@@ -0,0 +1,93 @@
+#include "common/job_pool.h"
+
+#include "common/trace.h"
+
+JobPool::JobPool(int n_workers) : next_item(0)
+{
+    resize(n_workers);
+}
+
+JobPool::~JobPool()
+{
+    resize(0);
+}
+
+void JobPool::resize(int n_workers)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+    workers.clear();
+
+    stopping = false;
+    for (int i = 0; i < n_workers; i++)
+        workers.emplace_back(&JobPool::work, this, generation);
+}
+
+void JobPool::runChunks()
+{
+    while (true)
+    {
+        int begin = next_item.fetch_add(JOB_CHUNK_SIZE);
+        if (begin >= n_items)
+            return;
+
+        int end = begin + JOB_CHUNK_SIZE < n_items ? begin + JOB_CHUNK_SIZE : n_items;
+        (*job)(begin, end);
+    }
+}
+
+void JobPool::work(unsigned seen)
+{
+    Trace::setThreadName("job worker");
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        runChunks();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0)
+            done.notify_one();
+    }
+}
+
+void JobPool::run(int n, const std::function<void(int, int)> &job)
+{
+    if (n <= 0)
+        return;
+
+    // not worth waking anyone up
+    if (workers.empty() || n <= JOB_CHUNK_SIZE)
+    {
+        job(0, n);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = &job;
+        n_items = n;
+        next_item = 0;
+        busy = (int)workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    runChunks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return busy == 0; });
+    this->job = nullptr;
+}
@@ -0,0 +1,115 @@
+#include "common/mapped_file.h"
+
+#include "loguru/loguru.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : ptr(nullptr), len(0), file(INVALID_HANDLE_VALUE), mapping(nullptr) {}
+
+bool MappedFile::open(const char *path)
+{
+    close();
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        LOG_F(ERROR, "could not open %s: error %lu", path, GetLastError());
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        LOG_F(ERROR, "could not map %s: empty file or unknown size", path);
+        close();
+        return false;
+    }
+    len = (size_t)file_size.QuadPart;
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (mapping)
+        ptr = (char *)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (!ptr)
+    {
+        LOG_F(ERROR, "could not map %s: error %lu", path, GetLastError());
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (ptr)
+        UnmapViewOfFile(ptr);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+
+    ptr = nullptr;
+    len = 0;
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() : ptr(nullptr), len(0) {}
+
+bool MappedFile::open(const char *path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        LOG_F(ERROR, "could not open %s", path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        LOG_F(ERROR, "could not map %s: empty file or unknown size", path);
+        ::close(fd);
+        return false;
+    }
+
+    void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if (p == MAP_FAILED)
+    {
+        LOG_F(ERROR, "could not map %s", path);
+        return false;
+    }
+
+    ptr = (char *)p;
+    len = (size_t)st.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (ptr)
+        munmap(ptr, len);
+    ptr = nullptr;
+    len = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
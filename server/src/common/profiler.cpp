@@ -0,0 +1,37 @@
+#include "common/profiler.h"
+
+#include "loguru/loguru.hpp"
+
+Profiler::Profiler(const char *const *names, int n_phases) : phases(n_phases), names(names) {}
+
+void Profiler::record(int phase, uint64_t ns)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    phases[phase].record(ns);
+}
+
+void Profiler::collect(PhaseStats *stats)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int i = 0; i < (int)phases.size(); i++)
+    {
+        stats[i].count = phases[i].count();
+        stats[i].p50 = phases[i].percentile(50);
+        stats[i].p99 = phases[i].percentile(99);
+        stats[i].max = phases[i].maxValue();
+        phases[i].reset();
+    }
+}
+
+void logPhases(const char *prefix, const char *const *names, const PhaseStats *stats, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (stats[i].count == 0)
+            continue;
+
+        LOG_F(INFO, "%s %s: n:%llu p50:%.1fus p99:%.1fus max:%.1fus", prefix, names[i],
+              (unsigned long long)stats[i].count,
+              stats[i].p50 / 1000.0, stats[i].p99 / 1000.0, stats[i].max / 1000.0);
+    }
+}
@@ -0,0 +1,68 @@
+#include "common/scheduler.h"
+
+#include <chrono>
+#include <thread>
+
+TickScheduler::TickScheduler(double period, int max_catch_up) : period_ns((unsigned long long)(period * 1000000000.0)), max_catch_up(max_catch_up)
+{
+    if (this->max_catch_up < 1)
+        this->max_catch_up = 1;
+    start();
+}
+
+void TickScheduler::start()
+{
+    last_tick = (tick_t)(Time::nowInNanoseconds() / period_ns);
+}
+
+int TickScheduler::wait(tick_t *first)
+{
+    unsigned long long deadline = (unsigned long long)(last_tick + 1) * period_ns;
+    unsigned long long now = Time::nowInNanoseconds();
+
+    if (now < deadline)
+    {
+        if (deadline - now > SCHEDULER_SPIN_NS)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now - SCHEDULER_SPIN_NS));
+
+        while ((now = Time::nowInNanoseconds()) < deadline)
+            std::this_thread::yield();
+    }
+
+    return takeDueTicks(now, first);
+}
+
+int TickScheduler::poll(tick_t *first)
+{
+    unsigned long long now = Time::nowInNanoseconds();
+    if (now < (unsigned long long)(last_tick + 1) * period_ns)
+        return 0;
+
+    return takeDueTicks(now, first);
+}
+
+Duration TickScheduler::timeBeforeNextTick() const
+{
+    unsigned long long deadline = (unsigned long long)(last_tick + 1) * period_ns;
+    unsigned long long now = Time::nowInNanoseconds();
+    return Duration::nanoseconds(now < deadline ? (int64_t)(deadline - now) : 0);
+}
+
+int TickScheduler::takeDueTicks(unsigned long long now, tick_t *first)
+{
+    // lateness relative to the boundary of the most recent due tick
+    tick_t due = (tick_t)(now / period_ns);
+    last_lateness = now - (unsigned long long)due * period_ns;
+
+    int n = due - last_tick;
+    if (n > max_catch_up)
+    {
+        dropped += n - max_catch_up;
+        n = max_catch_up;
+    }
+
+    *first = due - n + 1;
+    last_tick = due;
+
+    return n;
+}
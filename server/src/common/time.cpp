@@ -1,14 +1,76 @@
+#if defined(_WIN32)
 #include <windows.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+#ifdef USE_TSC_CLOCK
+#include <chrono>
+#include <thread>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
 #include <cmath>
 #include "common/time.h"
 
+#define TSC_CALIBRATION_MS 20
+
 unsigned long long Time::start_time = 0;
 unsigned long long Time::freq = 0;
+thread_local TimePoint Time::frame_time;
+thread_local bool Time::has_frame_time = false;
+
+// the clock of the OS, in counts of osFrequency() per second
+static unsigned long long osCounter()
+{
+#if defined(_WIN32)
+    unsigned long long now;
+    QueryPerformanceCounter((LARGE_INTEGER *)&now);
+    return now;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+static unsigned long long osFrequency()
+{
+#if defined(_WIN32)
+    unsigned long long freq;
+    QueryPerformanceFrequency((LARGE_INTEGER *)&freq);
+    return freq;
+#else
+    return 1000000000ULL;
+#endif
+}
+
+static inline unsigned long long counter()
+{
+#ifdef USE_TSC_CLOCK
+    return __rdtsc();
+#else
+    return osCounter();
+#endif
+}
 
 void Time::startNow()
 {
-    QueryPerformanceCounter((LARGE_INTEGER *)&Time::start_time);
-    QueryPerformanceFrequency((LARGE_INTEGER *)&Time::freq);
+#ifdef USE_TSC_CLOCK
+    // TSC counts per second, measured against the OS clock
+    unsigned long long os_start = osCounter();
+    unsigned long long tsc_start = __rdtsc();
+    std::this_thread::sleep_for(std::chrono::milliseconds(TSC_CALIBRATION_MS));
+    unsigned long long os_elapsed = osCounter() - os_start;
+    unsigned long long tsc_elapsed = __rdtsc() - tsc_start;
+    Time::freq = (unsigned long long)((double)tsc_elapsed * (double)osFrequency() / (double)os_elapsed);
+#else
+    Time::freq = osFrequency();
+#endif
+    Time::start_time = counter();
 }
 
 tick_t Time::msToTicks(unsigned long long ms, double period)
@@ -18,13 +80,41 @@ tick_t Time::msToTicks(unsigned long long ms, double period)
 
 unsigned long long Time::now()
 {
-    unsigned long long now;
-    QueryPerformanceCounter((LARGE_INTEGER *)&now);
-    return 1000 * (now - Time::start_time) / Time::freq;
+    return nowInNanoseconds() / 1000000ULL;
 }
 
 unsigned long long Time::nowInMilliseconds() { return now(); }
 
+unsigned long long Time::nowInNanoseconds()
+{
+    // split seconds and remainder so that the multiplication cannot overflow
+    unsigned long long elapsed = counter() - Time::start_time;
+    unsigned long long seconds = elapsed / Time::freq;
+    unsigned long long remainder = elapsed % Time::freq;
+    return seconds * 1000000000ULL + remainder * 1000000000ULL / Time::freq;
+}
+
+TimePoint Time::nowPoint()
+{
+    return TimePoint{(int64_t)nowInNanoseconds()};
+}
+
+void Time::publishFrameTime()
+{
+    frame_time = nowPoint();
+    has_frame_time = true;
+}
+
+TimePoint Time::frameTime()
+{
+    return has_frame_time ? frame_time : nowPoint();
+}
+
+tick_t Time::frameTicks(double period)
+{
+    return frameTime().toTicks(period);
+}
+
 unsigned long long Time::nextDeadline(double period)
 {
     unsigned long long now = Time::nowInMilliseconds();
@@ -46,6 +136,15 @@ struct timeval Time::timevalOfLongLong(unsigned long long time)
 {
     struct timeval res;
     res.tv_sec = (long)(time / 1000);
-    res.tv_usec = (long)((time - res.tv_sec) * 1000);
+    res.tv_usec = (long)((time % 1000) * 1000);
+    return res;
+}
+
+struct timeval Time::timevalOfDuration(Duration duration)
+{
+    int64_t us = duration.ns > 0 ? duration.toMicroseconds() : 0;
+    struct timeval res;
+    res.tv_sec = (long)(us / 1000000);
+    res.tv_usec = (long)(us % 1000000);
     return res;
 }
\ No newline at end of file
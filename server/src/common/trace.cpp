@@ -0,0 +1,218 @@
+#include "common/trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "loguru/loguru.hpp"
+
+#define TRACE_NAME_SIZE 32
+
+// events of one thread: written by that thread at `head`, read by the writer
+// thread at `tail`
+struct TraceBuffer
+{
+    TraceEvent events[TRACE_BUFFER_SIZE];
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+    std::atomic<uint32_t> dropped{0};
+    std::atomic<bool> in_use{true}; // false once its thread exited, it can be taken by a new one
+    int tid = 0;
+    char name[TRACE_NAME_SIZE] = {0};
+};
+
+// the buffers are never freed, a thread that exits leaves its buffer to the
+// next new thread
+static std::mutex registry_mutex;
+static std::vector<TraceBuffer *> buffers;
+static int next_tid = 1;
+
+struct ThreadTrace
+{
+    TraceBuffer *buffer = nullptr;
+    char name[TRACE_NAME_SIZE] = {0};
+
+    ~ThreadTrace()
+    {
+        if (buffer)
+            buffer->in_use.store(false, std::memory_order_release);
+    }
+};
+
+static thread_local ThreadTrace thread_trace;
+
+// capture state, only touched by the thread calling capture / stop and the writer
+static std::thread writer;
+static std::atomic<bool> capturing(false);
+static std::atomic<int64_t> capture_end(0); // ns
+
+std::atomic<bool> Trace::enabled(false);
+
+static TraceBuffer *acquireBuffer()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    TraceBuffer *buffer = nullptr;
+    for (TraceBuffer *b : buffers)
+        if (!b->in_use.load(std::memory_order_acquire))
+        {
+            buffer = b;
+            break;
+        }
+    if (!buffer)
+    {
+        buffer = new TraceBuffer();
+        buffers.push_back(buffer);
+    }
+
+    buffer->in_use.store(true, std::memory_order_relaxed);
+    buffer->tid = next_tid++;
+    if (thread_trace.name[0])
+        memcpy(buffer->name, thread_trace.name, TRACE_NAME_SIZE);
+    else
+        snprintf(buffer->name, TRACE_NAME_SIZE, "thread %d", buffer->tid);
+
+    return buffer;
+}
+
+void Trace::setThreadName(const char *name)
+{
+    snprintf(thread_trace.name, TRACE_NAME_SIZE, "%s", name);
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    if (thread_trace.buffer)
+        memcpy(thread_trace.buffer->name, thread_trace.name, TRACE_NAME_SIZE);
+}
+
+void Trace::record(const char *name, int64_t start, int64_t end, int arg)
+{
+    TraceBuffer *buffer = thread_trace.buffer;
+    if (!buffer)
+        buffer = thread_trace.buffer = acquireBuffer();
+
+    uint32_t head = buffer->head.load(std::memory_order_relaxed);
+    if (head - buffer->tail.load(std::memory_order_acquire) >= TRACE_BUFFER_SIZE)
+    {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    TraceEvent &event = buffer->events[head & (TRACE_BUFFER_SIZE - 1)];
+    event.name = name;
+    event.start = start;
+    event.duration = end - start;
+    event.arg = arg;
+    event.tid = buffer->tid;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+static std::vector<TraceBuffer *> copyBuffers()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    return buffers;
+}
+
+// writes the events of all buffers, returns how many
+static uint64_t drain(FILE *file, bool *first)
+{
+    uint64_t n = 0;
+    for (TraceBuffer *buffer : copyBuffers())
+    {
+        uint32_t tail = buffer->tail.load(std::memory_order_relaxed);
+        uint32_t head = buffer->head.load(std::memory_order_acquire);
+        for (; tail != head; tail++)
+        {
+            const TraceEvent &e = buffer->events[tail & (TRACE_BUFFER_SIZE - 1)];
+            fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                    *first ? "" : ",", e.name, e.tid, e.start / 1000.0, e.duration / 1000.0);
+            if (e.arg >= 0)
+                fprintf(file, ",\"args\":{\"id\":%d}", e.arg);
+            fputc('}', file);
+            *first = false;
+            n++;
+        }
+        buffer->tail.store(tail, std::memory_order_release);
+    }
+    return n;
+}
+
+void Trace::write(FILE *file, std::string path)
+{
+    bool first = true;
+    uint64_t n_events = 0;
+
+    fprintf(file, "{\"traceEvents\":[");
+    while ((int64_t)Time::nowInNanoseconds() < capture_end.load())
+    {
+        n_events += drain(file, &first);
+        std::this_thread::sleep_for(std::chrono::milliseconds(TRACE_FLUSH_MS));
+    }
+
+    // zones that began before the end are still recorded, give them a flush
+    enabled = false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(TRACE_FLUSH_MS));
+    n_events += drain(file, &first);
+
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (TraceBuffer *buffer : buffers)
+        {
+            fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",", buffer->tid, buffer->name);
+            first = false;
+            dropped += buffer->dropped.exchange(0);
+        }
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+
+    LOG_F(INFO, "trace written to %s: %llu zones, %llu dropped (full buffers)", path.c_str(),
+          (unsigned long long)n_events, (unsigned long long)dropped);
+    capturing = false;
+}
+
+bool Trace::capture(const char *path, Duration length)
+{
+    if (capturing)
+        return false;
+    if (writer.joinable())
+        writer.join();
+
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        LOG_F(ERROR, "cannot open trace file %s", path);
+        return false;
+    }
+
+    // forget what was recorded after the end of the last capture
+    for (TraceBuffer *buffer : copyBuffers())
+    {
+        buffer->tail.store(buffer->head.load(std::memory_order_acquire), std::memory_order_release);
+        buffer->dropped = 0;
+    }
+
+    capturing = true;
+    capture_end = (int64_t)Time::nowInNanoseconds() + length.ns;
+    enabled = true;
+    writer = std::thread(write, file, std::string(path));
+
+    LOG_F(INFO, "tracing to %s for %lld ms", path, (long long)length.toMilliseconds());
+    return true;
+}
+
+bool Trace::isCapturing()
+{
+    return capturing;
+}
+
+void Trace::stop()
+{
+    capture_end = 0;
+    if (writer.joinable())
+        writer.join();
+}
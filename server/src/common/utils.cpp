@@ -1,9 +1,11 @@
 #include "common/utils.h"
 
 #include "loguru/loguru.hpp"
+#include <atomic>
 #include <fstream>
 
-ID __id_cnt = 0;
+// shared by the network thread and the match threads
+std::atomic<ID> __id_cnt(0);
 ID freshID() { return __id_cnt++; }
 
 char *readFileBytes(const char *name, size_t *len)
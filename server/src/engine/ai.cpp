@@ -1,49 +1,124 @@
 #include "engine/ai.h"
 
-AI::AI(World *world) : world(world){};
+#include <cfloat>
+#include <cmath>
 
-int AI::getPlayerIndexById(ID id)
+#include "engine/collision.h"
+#include "engine/player.h"
+#include "engine/tilemap.h"
+
+
+AI::AI(const World *world) : world(world){};
+
+void AI::ensurePercept(const Entity *entity, AIState &state) const
+{
+    Percept &percept = state.percept;
+    if (percept.valid)
+        return;
+
+    percept = Percept();
+    percept.valid = true;
+    percept.visible_dist2 = FLT_MAX;
+
+    const TilemapDesc *map = world->getPathfinder()->getTilemap();
+    Vec2f pos = entity->middle();
+    float closest_dist2 = FLT_MAX;
+    for (const Player *player : world->getPlayers())
+    {
+        if (!player->alive)
+            continue;
+
+        Vec2f delta = player->middle() - pos;
+        float d2 = delta.x * delta.x + delta.y * delta.y;
+        if (d2 < closest_dist2)
+        {
+            percept.target = player;
+            closest_dist2 = d2;
+        }
+
+        if (d2 > PERCEPTION_RANGE * PERCEPTION_RANGE || d2 >= percept.visible_dist2)
+            continue;
+
+        float dist = sqrtf(d2);
+        if (dist <= 0 || computeDistance(pos, delta / dist, dist, map) >= dist)
+        {
+            percept.visible = player;
+            percept.visible_dist2 = d2;
+        }
+    }
+
+    percept.target_dist2 = closest_dist2;
+    percept.target_in_sight = percept.target && percept.target == percept.visible;
+}
+
+Vec2f AI::findNextGoal(const Vec2f pos, const Player *target) const
 {
-    for (unsigned int i = 0; i < entities.size(); i++)
-        if (entities[i]->id == id)
-            return i;
-    return -1;
+    const Pathfinder *pathfinder = world->getPathfinder();
+    const TilemapDesc *map = pathfinder->getTilemap();
+    const FlowField *field = pathfinder->getField(target->id);
+
+    Vec2i next;
+    if (field && field->getNextTile(map->xyOfWorldPos(pos), &next))
+    {
+        float half_tile = map->tile_size * map->scale * 0.5f;
+        return map->worldPosOfXY(next) + Vec2f(half_tile, half_tile);
+    }
+    return target->middle();
 }
 
-LinePath::LinePath(World *world, double size) : AI(world), size(size)
+uint8_t AI::steer(const Vec2f from, const Vec2f to)
 {
-    ctrl_left.movement = MOVE_LEFT;
-    ctrl_right.movement = MOVE_RIGHT;
+    uint8_t movement = 0;
+    Vec2f delta = to - from;
+    if (delta.x > CHASE_DEADZONE)
+        movement |= MOVE_RIGHT;
+    else if (delta.x < -CHASE_DEADZONE)
+        movement |= MOVE_LEFT;
+    if (delta.y > CHASE_DEADZONE)
+        movement |= MOVE_DOWN;
+    else if (delta.y < -CHASE_DEADZONE)
+        movement |= MOVE_UP;
+    return movement;
 }
 
-Control LinePath::makeNextControl(Entity *entity)
+LinePath::LinePath(const World *world, double size) : AI(world), size(size) {}
+
+Control LinePath::makeNextControl(const Entity *entity, AIState &state) const
 {
-    int i = getPlayerIndexById(entity->id);
-    if (i < 0)
+    Vec2f pos = entity->topleft();
+    if (!state.started)
     {
-        entities.push_back(entity);
+        state.origin = pos;
+        state.last_movement = MOVE_RIGHT;
+        state.started = true;
+    }
 
-        Vec2f pos = entity->topleft();
-        initial_pos.push_back(pos);
-        last_ctrl.push_back(nullptr);
+    if (pos.x >= state.origin.x + size)
+        state.last_movement = MOVE_LEFT;
+    else if (pos.x <= state.origin.x)
+        state.last_movement = MOVE_RIGHT;
 
-        i = (int)entities.size() - 1;
-    }
+    Control res = {0};
+    res.movement = state.last_movement;
+    return res;
+}
 
-    Vec2f pos = entities[i]->topleft();
+Chase::Chase(const World *world) : AI(world) {}
 
-    Control *res;
+Control Chase::makeNextControl(const Entity *entity, AIState &state) const
+{
+    Control ctrl = {0};
+    Vec2f pos = entity->middle();
+
+    ensurePercept(entity, state);
+    const Player *closest = state.percept.target;
+    if (!closest || state.percept.target_dist2 < CHASE_STOP_DIST * CHASE_STOP_DIST)
+        return ctrl;
 
-    if (pos.x >= initial_pos[i].x + size)
-        res = &ctrl_left;
-    else if (pos.x <= initial_pos[i].x)
-        res = &ctrl_right;
-    else if (last_ctrl[i])
-        res = last_ctrl[i];
-    else
-        res = &ctrl_right;
+    ctrl.movement = steer(pos, findNextGoal(pos, closest));
 
-    last_ctrl[i] = res;
+    Vec2f aim = closest->middle() - pos;
+    ctrl.facing_angle = atan2f(aim.y, aim.x);
 
-    return *res;
-}
\ No newline at end of file
+    return ctrl;
+}
@@ -0,0 +1,173 @@
+#include "engine/ai_scheduler.h"
+
+#include <cfloat>
+#include <chrono>
+
+#include "common/trace.h"
+#include "engine/ai.h"
+#include "engine/enemy.h"
+#include "engine/player.h"
+
+// in ticks, by tier
+static const int THINK_PERIOD[N_AI_TIERS] = {1, 4, 16, 60};
+
+AIScheduler::AIScheduler()
+{
+    batch.reserve(AI_BATCH_SIZE);
+    batch_entities.resize(AI_BATCH_SIZE);
+    batch_needs_sight = std::make_unique<bool[]>(AI_BATCH_SIZE);
+    percepts.resize(AI_BATCH_SIZE);
+    decisions.resize(AI_BATCH_SIZE);
+}
+
+void AIScheduler::add(NPC *npc)
+{
+    npc->getAIController()->setScheduled(true);
+    npcs.push_back(npc);
+}
+
+void AIScheduler::remove(Entity *entity)
+{
+    for (int i = 0; i < (int)npcs.size(); i++)
+        if (npcs[i] == entity)
+        {
+            npcs[i]->getAIController()->setScheduled(false);
+            npcs[i] = npcs.back();
+            npcs.pop_back();
+            return;
+        }
+}
+
+AITier AIScheduler::computeTier(NPC *npc, tick_t current_tick, const std::vector<Player *> &players) const
+{
+    AIController *controller = npc->getAIController();
+
+    // hurt since the last think
+    if (npc->health < controller->last_health)
+        controller->combat_until = current_tick + AI_COMBAT_TICKS;
+    controller->last_health = npc->health;
+
+    if (current_tick < controller->combat_until)
+        return AI_TIER_NEAR;
+
+    Vec2f pos = npc->middle();
+    float closest = FLT_MAX;
+    bool any_player = false;
+    for (Player *player : players)
+    {
+        if (!player->alive)
+            continue;
+
+        Vec2f delta = player->middle() - pos;
+        float dist2 = delta.x * delta.x + delta.y * delta.y;
+        if (dist2 < closest)
+            closest = dist2;
+        any_player = true;
+    }
+
+    if (!any_player)
+        return AI_TIER_IDLE;
+    if (closest < AI_NEAR_DIST * AI_NEAR_DIST)
+        return AI_TIER_NEAR;
+    if (closest < AI_MID_DIST * AI_MID_DIST)
+        return AI_TIER_MID;
+    return AI_TIER_FAR;
+}
+
+void AIScheduler::think(int n)
+{
+    if (perception)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            batch_entities[i] = batch[i];
+            batch_needs_sight[i] = batch[i]->getAIController()->getAI()->needsSight();
+        }
+        TraceZone zone("perceive");
+        perception->perceive(batch_entities.data(), batch_needs_sight.get(), n, percepts.data());
+        for (int i = 0; i < n; i++)
+            batch[i]->getAIController()->getState()->percept = percepts[i];
+    }
+    else
+        for (int i = 0; i < n; i++)
+            batch[i]->getAIController()->getState()->percept.valid = false;
+
+    std::function<void(int, int)> job = [this](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            TraceZone zone("think", batch[i]->id);
+            AIController *controller = batch[i]->getAIController();
+            decisions[i] = controller->getAI()->makeNextControl(batch[i], *controller->getState());
+        }
+    };
+    jobs.run(n, job);
+
+    for (int i = 0; i < n; i++)
+        batch[i]->getAIController()->setControl(decisions[i]);
+}
+
+void AIScheduler::update(tick_t current_tick, const std::vector<Player *> &players)
+{
+    int n = (int)npcs.size();
+    if (n == 0)
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+
+    next %= n;
+    batch.clear();
+    int n_thinks = 0;
+    int resume = 0; // where to start on the next tick
+    for (int k = 0; k < n; k++)
+    {
+        int i = (next + k) % n;
+        NPC *npc = npcs[i];
+        AIController *controller = npc->getAIController();
+        if (controller->next_think > current_tick || !controller->getAI())
+            continue;
+
+        if (n_thinks == AI_MAX_THINKS)
+        {
+            // the NPCs left keep their last control, they go first next tick
+            for (int j = k; j < n; j++)
+                if (npcs[(next + j) % n]->getAIController()->next_think <= current_tick)
+                    metrics.postponed++;
+            resume = i;
+            break;
+        }
+
+        if (batch.size() == AI_BATCH_SIZE)
+        {
+            think((int)batch.size());
+            batch.clear();
+        }
+
+        n_thinks++;
+        AITier tier = computeTier(npc, current_tick, players);
+        batch.push_back(npc);
+        metrics.thinks[tier]++;
+
+        // next think on the next tick of the period that matches the id, so
+        // that NPCs of a tier are spread over the period
+        int period = THINK_PERIOD[tier];
+        int phase = (int)(((unsigned)npc->id + (unsigned)current_tick) % (unsigned)period);
+        controller->next_think = current_tick + period - phase;
+    }
+
+    think((int)batch.size());
+    batch.clear();
+    next = resume;
+
+    uint64_t us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    if (us > AI_THINK_BUDGET_US)
+        metrics.over_budget++;
+    if (us > metrics.max_think_us)
+        metrics.max_think_us = us;
+}
+
+AISchedulerMetrics AIScheduler::collectMetrics()
+{
+    AISchedulerMetrics res = metrics;
+    metrics = {};
+    return res;
+}
@@ -0,0 +1,302 @@
+#include "engine/behavior.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "tinyxml/tinyxml2.h"
+#include "loguru/loguru.hpp"
+
+#include "engine/player.h"
+#include "engine/tilemap.h"
+
+#define STRAFE_LOOKAHEAD 100.0f // in pixels, how far sideways the strafe goal is
+
+struct BehaviorOpDesc
+{
+    const char *tag;
+    BehaviorOp op;
+    const char *param; // name of the attribute giving the parameter, nullptr if none
+};
+
+static const BehaviorOpDesc OP_DESCS[N_BT_OPS] = {
+    {"selector", BT_SELECTOR, nullptr},
+    {"sequence", BT_SEQUENCE, nullptr},
+    {"target_within", BT_TARGET_WITHIN, "distance"},
+    {"in_sight", BT_IN_SIGHT, nullptr},
+    {"health_below", BT_HEALTH_BELOW, "ratio"},
+    {"idle", BT_IDLE, nullptr},
+    {"patrol", BT_PATROL, "distance"},
+    {"chase", BT_CHASE, nullptr},
+    {"flee", BT_FLEE, nullptr},
+    {"strafe", BT_STRAFE, "every"},
+    {"shoot", BT_SHOOT, nullptr},
+};
+
+std::vector<BehaviorTree> Behaviors::trees;
+
+bool Behaviors::compile(const tinyxml2::XMLElement *e, std::vector<BehaviorNode> &nodes)
+{
+    const BehaviorOpDesc *desc = nullptr;
+    for (const BehaviorOpDesc &d : OP_DESCS)
+        if (strcmp(e->Name(), d.tag) == 0)
+            desc = &d;
+
+    if (!desc)
+    {
+        LOG_F(ERROR, "unknown behavior node <%s>", e->Name());
+        return false;
+    }
+
+    BehaviorNode node = {desc->op, 0, 0};
+    if (desc->param && e->QueryFloatAttribute(desc->param, &node.param) != tinyxml2::XML_SUCCESS)
+    {
+        LOG_F(ERROR, "behavior node <%s> needs a %s attribute", e->Name(), desc->param);
+        return false;
+    }
+
+    int i = (int)nodes.size();
+    nodes.push_back(node);
+
+    bool composite = desc->op == BT_SELECTOR || desc->op == BT_SEQUENCE;
+    for (const tinyxml2::XMLElement *child = e->FirstChildElement(); child != nullptr; child = child->NextSiblingElement())
+    {
+        if (!composite)
+        {
+            LOG_F(WARNING, "children of behavior node <%s> ignored", e->Name());
+            break;
+        }
+        if (!compile(child, nodes))
+            return false;
+    }
+
+    if (nodes.size() > UINT16_MAX)
+    {
+        LOG_F(ERROR, "behavior tree too large");
+        return false;
+    }
+    nodes[i].next = (uint16_t)nodes.size();
+
+    return true;
+}
+
+void Behaviors::loadFromFile(std::string file_path)
+{
+    tinyxml2::XMLDocument doc;
+    int ret = doc.LoadFile(file_path.c_str());
+    if (ret != tinyxml2::XML_SUCCESS)
+    {
+        LOG_F(ERROR, "behaviors couldn't be loaded: %d", ret);
+        return;
+    }
+
+    tinyxml2::XMLElement *behaviors_element = doc.FirstChildElement("behaviors");
+    if (!behaviors_element)
+    {
+        LOG_F(ERROR, "no <behaviors> in %s", file_path.c_str());
+        return;
+    }
+
+    for (tinyxml2::XMLElement *e = behaviors_element->FirstChildElement("behavior"); e != NULL; e = e->NextSiblingElement("behavior"))
+    {
+        BehaviorTree tree;
+        tree.name = e->Attribute("name") ? e->Attribute("name") : "";
+
+        const tinyxml2::XMLElement *root = e->FirstChildElement();
+        if (tree.name.empty() || !root)
+        {
+            LOG_F(ERROR, "behavior without a name or a root node (ignored)");
+            continue;
+        }
+
+        if (!compile(root, tree.nodes))
+        {
+            LOG_F(ERROR, "behavior %s ignored", tree.name.c_str());
+            continue;
+        }
+
+        trees.push_back(tree);
+    }
+}
+
+const BehaviorTree *Behaviors::get(const std::string &name)
+{
+    for (const BehaviorTree &tree : trees)
+        if (tree.name == name)
+            return &tree;
+    return nullptr;
+}
+
+int BehaviorAI::Blackboard::add()
+{
+    if (free_rows.size() > 0)
+    {
+        int row = free_rows.back();
+        free_rows.pop_back();
+        return row;
+    }
+
+    origin_x.push_back(0);
+    origin_y.push_back(0);
+    patrol_dir.push_back(0);
+    strafe_dir.push_back(0);
+    strafe_left.push_back(0);
+    return (int)origin_x.size() - 1;
+}
+
+void BehaviorAI::Blackboard::remove(int row)
+{
+    free_rows.push_back(row);
+}
+
+BehaviorAI::BehaviorAI(const World *world, const BehaviorTree *tree) : AI(world), tree(tree), needs_sight(false)
+{
+    for (const BehaviorNode &node : tree->nodes)
+        if (node.op == BT_IN_SIGHT)
+            needs_sight = true;
+}
+
+void BehaviorAI::attach(AIState &state)
+{
+    int row = blackboard.add();
+    blackboard.patrol_dir[row] = 0; // not patrolling yet
+    blackboard.strafe_dir[row] = 1;
+    blackboard.strafe_left[row] = 0;
+    state.slot = row;
+}
+
+void BehaviorAI::detach(AIState &state)
+{
+    if (state.slot < 0)
+        return;
+
+    blackboard.remove(state.slot);
+    state.slot = -1;
+}
+
+void BehaviorAI::aim(Context &c) const
+{
+    Vec2f aim = c.target->middle() - c.pos;
+    c.ctrl.facing_angle = atan2f(aim.y, aim.x);
+}
+
+bool BehaviorAI::run(int i, Context &c) const
+{
+    const BehaviorNode &node = tree->nodes[i];
+
+    switch (node.op)
+    {
+    case BT_SELECTOR:
+        for (int child = i + 1; child < node.next; child = tree->nodes[child].next)
+            if (run(child, c))
+                return true;
+        return false;
+
+    case BT_SEQUENCE:
+        for (int child = i + 1; child < node.next; child = tree->nodes[child].next)
+            if (!run(child, c))
+                return false;
+        return true;
+
+    case BT_TARGET_WITHIN:
+        return c.target && c.target_dist2 <= node.param * node.param;
+
+    case BT_IN_SIGHT:
+        return c.target_in_sight;
+
+    case BT_HEALTH_BELOW:
+        return c.entity->health < node.param * c.entity->max_health;
+
+    case BT_IDLE:
+        c.ctrl.movement = 0;
+        return true;
+
+    case BT_PATROL:
+    {
+        int8_t &dir = blackboard.patrol_dir[c.row];
+        float &origin_x = blackboard.origin_x[c.row];
+        if (dir == 0)
+        {
+            origin_x = c.pos.x;
+            blackboard.origin_y[c.row] = c.pos.y;
+            dir = 1;
+        }
+
+        if (c.pos.x >= origin_x + node.param)
+            dir = -1;
+        else if (c.pos.x <= origin_x)
+            dir = 1;
+
+        c.ctrl.movement = dir > 0 ? MOVE_RIGHT : MOVE_LEFT;
+        return true;
+    }
+
+    case BT_CHASE:
+        if (!c.target)
+            return false;
+
+        if (c.target_dist2 >= CHASE_STOP_DIST * CHASE_STOP_DIST)
+            c.ctrl.movement = steer(c.pos, findNextGoal(c.pos, c.target));
+        aim(c);
+        return true;
+
+    case BT_FLEE:
+        if (!c.target)
+            return false;
+
+        c.ctrl.movement = steer(c.pos, c.pos * 2.0f - c.target->middle());
+        aim(c);
+        return true;
+
+    case BT_STRAFE:
+    {
+        if (!c.target || c.target_dist2 <= 0)
+            return false;
+
+        int8_t &dir = blackboard.strafe_dir[c.row];
+        uint16_t &left = blackboard.strafe_left[c.row];
+        if (left == 0)
+        {
+            dir = -dir;
+            left = (uint16_t)node.param;
+        }
+        else
+            left--;
+
+        // around the target, perpendicular to the line of sight
+        Vec2f to_target = (c.target->middle() - c.pos) / sqrtf(c.target_dist2);
+        Vec2f side = Vec2f(-to_target.y, to_target.x) * (float)dir;
+        c.ctrl.movement = steer(c.pos, c.pos + side * STRAFE_LOOKAHEAD);
+        aim(c);
+        return true;
+    }
+
+    case BT_SHOOT:
+        if (!c.target)
+            return false;
+
+        c.ctrl.shoot = true;
+        aim(c);
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+Control BehaviorAI::makeNextControl(const Entity *entity, AIState &state) const
+{
+    Context c;
+    c.entity = entity;
+    c.row = state.slot;
+    c.pos = entity->middle();
+    ensurePercept(entity, state);
+    c.target = state.percept.target;
+    c.target_dist2 = state.percept.target_dist2;
+    c.target_in_sight = state.percept.target_in_sight;
+    c.ctrl = {0};
+
+    if (c.row >= 0 && tree->nodes.size() > 0)
+        run(0, c);
+
+    return c.ctrl;
+}
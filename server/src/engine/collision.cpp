@@ -1,5 +1,8 @@
 #include "engine/collision.h"
 
+#include <cfloat>
+#include <cmath>
+#include <vector>
 #include "loguru/loguru.hpp"
 
 #include "engine/game_config.h"
@@ -15,13 +18,11 @@ bool overlaps(Vec2f pos1, Vec2f size1, Vec2f pos2, Vec2f size2)
     return overlaps(pos1.x, pos1.y, size1.x, size1.y, pos2.x, pos2.y, size2.x, size2.y);
 }
 
-bool intersects(Vec2f ray_origin, float ray_angle, Vec2f sphere_origin, float sphere_radius)
+bool intersects(Vec2f ray_origin, Vec2f ray_dir, Vec2f sphere_origin, float sphere_radius)
 {
-    Vec2f dir = Vec2f((float)cos(ray_angle), (float)sin(ray_angle));
-
     Vec2f L = ray_origin - sphere_origin;
-    float a = dir * dir;
-    float b = 2 * dir * L;
+    float a = ray_dir * ray_dir;
+    float b = 2 * ray_dir * L;
     float c = L * L - sphere_radius * sphere_radius;
 
     float d = b * b - 4 * a * c;
@@ -29,91 +30,349 @@ bool intersects(Vec2f ray_origin, float ray_angle, Vec2f sphere_origin, float sp
     return d >= 0;
 }
 
-float computeDistance(Vec2f ray_origin, float ray_angle, Vec2f sphere_origin, float sphere_radius)
+bool intersects(Vec2f ray_origin, float ray_angle, Vec2f sphere_origin, float sphere_radius)
 {
-    Vec2f dir = Vec2f((float)cos(ray_angle), (float)sin(ray_angle));
+    return intersects(ray_origin, Vec2f(cosf(ray_angle), sinf(ray_angle)), sphere_origin, sphere_radius);
+}
 
-    float t = (sphere_origin - ray_origin) * dir;
+float computeDistance(Vec2f ray_origin, Vec2f ray_dir, Vec2f sphere_origin, float sphere_radius)
+{
+    float t = (sphere_origin - ray_origin) * ray_dir;
 
-    Vec2f p = ray_origin + t * dir;
-    float y = (float)sqrt((sphere_origin - p) * (sphere_origin - p));
+    Vec2f p = ray_origin + t * ray_dir;
+    float y2 = (sphere_origin - p) * (sphere_origin - p);
+    float r2 = sphere_radius * sphere_radius;
 
-    if (y > sphere_radius)
+    if (y2 > r2)
         return -1;
 
-    float x = (float)sqrt((double)sphere_radius * (double)sphere_radius - (double)y * (double)y);
-
-    return t - x;
+    return t - sqrtf(r2 - y2);
 }
 
-float computeDistance(Vec2f ray_origin, float ray_angle, float range, const TilemapDesc *map)
+float computeDistance(Vec2f ray_origin, float ray_angle, Vec2f sphere_origin, float sphere_radius)
 {
-    int tile_size = map->tile_size * map->scale;
+    return computeDistance(ray_origin, Vec2f(cosf(ray_angle), sinf(ray_angle)), sphere_origin, sphere_radius);
+}
 
-    Vec2f pos = ray_origin / (float)tile_size;
-    Vec2i map_pos = Vec2i((int)pos.x, (int)pos.y);
-    Vec2f dir = Vec2f((float)cos(ray_angle), (float)sin(ray_angle));
+// floor for values that may be slightly negative
+static inline int floorToInt(float v)
+{
+    int i = (int)v;
+    return i - (v < i);
+}
 
-    float delta_dist_x = dir.y == 0 ? 0 : dir.x == 0 ? 1 : (float)abs(1. / dir.x);
-    float delta_dist_y = dir.x == 0 ? 0 : dir.y == 0 ? 1 : (float)abs(1. / dir.y);
+// keeps v within [low, high] (rounding errors)
+static inline int clampToRange(int v, int low, int high)
+{
+    return v < low ? low : v > high ? high : v;
+}
 
-    int step_x;
-    int step_y;
-    float side_dist_x;
-    float side_dist_y;
+// Leaves the box [x0, x1] * [y0, y1] of empty tiles the ray is in: steps into
+// the tile just outside of it, along the axis the ray leaves it by, the other
+// coordinate is where the ray crosses the edge. Stores in `exit` the distance
+// along the ray at which that tile is entered.
+// Positions are in tiles, `inv_x`/`inv_y` are 1 / dir (unused if dir is 0 on
+// that axis).
+static inline void traceBox(float pos_x, float pos_y, float dir_x, float dir_y, float inv_x, float inv_y,
+                            int x0, int y0, int x1, int y1, int &x, int &y, float &exit)
+{
+    float edge_x = dir_x > 0 ? (float)(x1 + 1) : (float)x0;
+    float edge_y = dir_y > 0 ? (float)(y1 + 1) : (float)y0;
+    float exit_x = dir_x == 0 ? FLT_MAX : (edge_x - pos_x) * inv_x;
+    float exit_y = dir_y == 0 ? FLT_MAX : (edge_y - pos_y) * inv_y;
 
-    if (dir.x < 0)
+    if (exit_x < exit_y)
     {
-        step_x = -1;
-        side_dist_x = (pos.x - map_pos.x) * delta_dist_x;
+        exit = exit_x;
+        y = clampToRange(floorToInt(pos_y + exit * dir_y), y0, y1);
+        x = dir_x > 0 ? x1 + 1 : x0 - 1;
     }
     else
     {
-        step_x = 1;
-        side_dist_x = (map_pos.x + 1 - pos.x) * delta_dist_x;
+        exit = exit_y;
+        x = clampToRange(floorToInt(pos_x + exit * dir_x), x0, x1);
+        y = dir_y > 0 ? y1 + 1 : y0 - 1;
     }
+}
 
-    if (dir.y < 0)
+// Sphere tracing over the distance field. A tile of clearance d is the center
+// of an empty square of (2d - 1) * (2d - 1) tiles, so the ray can go straight
+// to the edge of that square. Next to walls (d == 1) the square is the tile
+// itself and this is a regular DDA step, in open space it skips many tiles at
+// once. The ray stops on entering a tile of clearance 0.
+// The field saturates at MAX_CLEARANCE, past that the empty region around the
+// tile (see CollisionMap::summarize) is used when it lets the ray go further,
+// so crossing a large empty area takes a couple of steps whatever its size.
+// Moves (x, y, d) to the next tile and stores in `exit` the distance along the
+// ray at which it is entered.
+static inline void traceStep(float pos_x, float pos_y, float dir_x, float dir_y, float inv_x, float inv_y,
+                             int &x, int &y, int &d, float &exit, const TilemapDesc *map)
+{
+    int next_x = x;
+    int next_y = y;
+    traceBox(pos_x, pos_y, dir_x, dir_y, inv_x, inv_y, x - d + 1, y - d + 1, x + d - 1, y + d - 1, next_x, next_y, exit);
+
+    if (d == MAX_CLEARANCE && map->collisions->getRegionState(x, y) == REGION_EMPTY)
     {
-        step_y = -1;
-        side_dist_y = (pos.y - map_pos.y) * delta_dist_y;
+        int x0 = x & ~(REGION_SIZE - 1);
+        int y0 = y & ~(REGION_SIZE - 1);
+        int x1 = x0 + REGION_SIZE > map->width ? map->width - 1 : x0 + REGION_SIZE - 1;
+        int y1 = y0 + REGION_SIZE > map->height ? map->height - 1 : y0 + REGION_SIZE - 1;
+
+        int region_x = x;
+        int region_y = y;
+        float region_exit;
+        traceBox(pos_x, pos_y, dir_x, dir_y, inv_x, inv_y, x0, y0, x1, y1, region_x, region_y, region_exit);
+        if (region_exit > exit)
+        {
+            exit = region_exit;
+            next_x = region_x;
+            next_y = region_y;
+        }
     }
-    else
+
+    x = next_x;
+    y = next_y;
+    d = map->clearance->get(x, y);
+}
+
+// clearance of the tile of the ray origin, -1 if it is out of the map.
+// The tile of the origin is never a hit.
+static inline int traceStart(const TilemapDesc *map, int x, int y)
+{
+    if (x < -1 || x > map->width || y < -1 || y > map->height)
+        return -1;
+
+    int d = map->clearance->get(x, y);
+    return d == 0 ? 1 : d;
+}
+
+float computeDistance(Vec2f ray_origin, Vec2f ray_dir, float range, const TilemapDesc *map)
+{
+    const float tile_size = (float)(map->tile_size * map->scale);
+    const float max_dist = range / tile_size;
+    const Vec2f pos = ray_origin / tile_size;
+    const float inv_x = ray_dir.x == 0 ? 0 : 1.0f / ray_dir.x;
+    const float inv_y = ray_dir.y == 0 ? 0 : 1.0f / ray_dir.y;
+
+    int x = floorToInt(pos.x);
+    int y = floorToInt(pos.y);
+    int d = traceStart(map, x, y);
+    if (d < 0)
+        return 0;
+
+    float exit;
+    while (true)
     {
-        step_y = 1;
-        side_dist_y = (map_pos.y + 1 - pos.y) * delta_dist_y;
+        traceStep(pos.x, pos.y, ray_dir.x, ray_dir.y, inv_x, inv_y, x, y, d, exit, map);
+        if (exit > max_dist)
+            return range;
+        if (d == 0)
+            return exit * tile_size;
     }
+}
 
-    bool hit = false;
-    int side;
-    float wall_dist;
-    while (!hit)
+float computeDistance(Vec2f ray_origin, float ray_angle, float range, const TilemapDesc *map)
+{
+    return computeDistance(ray_origin, Vec2f(cosf(ray_angle), sinf(ray_angle)), range, map);
+}
+
+// per ray state of computeDistances, as arrays
+struct TraceBatch
+{
+    std::vector<float> pos_x;
+    std::vector<float> pos_y;
+    std::vector<float> inv_x;
+    std::vector<float> inv_y;
+    std::vector<float> max_dist;
+};
+
+// The setup of all rays is done in one pass over arrays, then each ray is
+// traced to the end on its own: advancing all of them in lockstep was measured
+// slower, the field lookups can't be vectorized and the state of a ray fits in
+// registers when it is traced alone.
+void computeDistances(const RayBatch &rays, const TilemapDesc *map, float *out_dist)
+{
+    // scratch buffers, one set per match thread
+    static thread_local TraceBatch batch;
+
+    const int n = rays.size();
+    const float tile_size = (float)(map->tile_size * map->scale);
+    const float inv_tile_size = 1.0f / tile_size;
+
+    batch.pos_x.resize(n);
+    batch.pos_y.resize(n);
+    batch.inv_x.resize(n);
+    batch.inv_y.resize(n);
+    batch.max_dist.resize(n);
+
+    float *pos_x = batch.pos_x.data();
+    float *pos_y = batch.pos_y.data();
+    float *inv_x = batch.inv_x.data();
+    float *inv_y = batch.inv_y.data();
+    float *max_dist = batch.max_dist.data();
+    const float *dir_x = rays.dir_x.data();
+    const float *dir_y = rays.dir_y.data();
+
+    // no dependency between rays here, this loop vectorizes
+    for (int i = 0; i < n; i++)
     {
-        if (side_dist_x < side_dist_y)
+        pos_x[i] = rays.x[i] * inv_tile_size;
+        pos_y[i] = rays.y[i] * inv_tile_size;
+        inv_x[i] = dir_x[i] == 0 ? 0 : 1.0f / dir_x[i];
+        inv_y[i] = dir_y[i] == 0 ? 0 : 1.0f / dir_y[i];
+        max_dist[i] = rays.range[i] * inv_tile_size;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        int x = floorToInt(pos_x[i]);
+        int y = floorToInt(pos_y[i]);
+        int d = traceStart(map, x, y);
+        if (d < 0)
         {
-            side_dist_x += delta_dist_x;
-            map_pos.x += step_x;
-            side = 0;
+            out_dist[i] = 0;
+            continue;
+        }
+
+        float exit;
+        while (true)
+        {
+            traceStep(pos_x[i], pos_y[i], dir_x[i], dir_y[i], inv_x[i], inv_y[i], x, y, d, exit, map);
+            if (exit > max_dist[i])
+            {
+                out_dist[i] = rays.range[i];
+                break;
+            }
+            if (d == 0)
+            {
+                out_dist[i] = exit * tile_size;
+                break;
+            }
+        }
+    }
+}
+
+#define SWEEP_EPSILON 0.01f // a box touching a tile does not overlap it
+
+// floor(v / tile_size), without a call to floorf
+static inline int tileOf(float v, float inv_tile_size)
+{
+    float t = v * inv_tile_size;
+    int i = (int)t;
+    return i - (t < i);
+}
+
+// Bounds of the tiles of a range of positions, in one float to int conversion
+// instead of the two of tileOf: the first one may be one tile lower and the
+// last one tile higher than tileOf says, so tiles are never left out. Right
+// from tile -1 only, which is all the collision map tells apart.
+#define TILE_MARGIN (1.0f / 256) // in tiles, more than the rounding errors on maps up to 32768 tiles wide
+
+static inline int firstTileOf(float v, float inv_tile_size)
+{
+    return (int)(v * inv_tile_size + (1.0f - TILE_MARGIN)) - 1;
+}
+
+static inline int lastTileOf(float v, float inv_tile_size)
+{
+    return (int)(v * inv_tile_size + 1.0f) - 1;
+}
+
+// Along x, the tiles the box goes through are the same run of columns on each
+// row it covers: one scan of those rows gives the closest solid tile in the
+// direction of the move. Along y, the same is done on the columns it covers.
+// An axis along which the box stays on the tiles it is already on doesn't
+// read the collision map.
+Vec2f sweepBoxScan(Vec2f pos, Vec2f size, Vec2f delta, const TilemapDesc *map)
+{
+    const CollisionMap *solid = map->collisions;
+    const float tile_size = (float)(map->tile_size * map->scale);
+    const float inv_tile_size = 1.0f / tile_size;
+
+    int left = tileOf(pos.x, inv_tile_size);
+    int right = tileOf(pos.x + size.x - SWEEP_EPSILON, inv_tile_size);
+    int new_left = tileOf(pos.x + delta.x, inv_tile_size);
+    int new_right = tileOf(pos.x + size.x + delta.x - SWEEP_EPSILON, inv_tile_size);
+
+    if (new_left == left && new_right == right)
+        pos.x += delta.x;
+    else
+    {
+        int row_first = tileOf(pos.y, inv_tile_size);
+        int row_last = tileOf(pos.y + size.y - SWEEP_EPSILON, inv_tile_size);
+
+        if (delta.x > 0)
+        {
+            // closest solid column on the right of the box
+            int wall = solid->findFirstSolidInRows(right + 1, new_right, row_first, row_last);
+
+            pos.x = wall <= new_right ? wall * tile_size - size.x : pos.x + delta.x;
         }
         else
         {
-            side_dist_y += delta_dist_y;
-            map_pos.y += step_y;
-            side = 1;
+            // closest solid column on the left of the box
+            int wall = solid->findLastSolidInRows(new_left, left - 1, row_first, row_last);
+
+            pos.x = wall >= new_left ? (wall + 1) * tile_size : pos.x + delta.x;
         }
+    }
 
-        hit = map->collisions->get(map->indexOfXY(map_pos.x, map_pos.y));
+    int top = tileOf(pos.y, inv_tile_size);
+    int bottom = tileOf(pos.y + size.y - SWEEP_EPSILON, inv_tile_size);
+    int new_top = tileOf(pos.y + delta.y, inv_tile_size);
+    int new_bottom = tileOf(pos.y + size.y + delta.y - SWEEP_EPSILON, inv_tile_size);
 
-        if (side == 0)
-            wall_dist = (map_pos.x - pos.x + (1 - step_x) / 2) / dir.x;
+    if (new_top == top && new_bottom == bottom)
+        pos.y += delta.y;
+    else
+    {
+        int col_first = tileOf(pos.x, inv_tile_size);
+        int col_last = tileOf(pos.x + size.x - SWEEP_EPSILON, inv_tile_size);
+
+        if (delta.y > 0)
+        {
+            int wall = solid->findFirstSolidInColumns(bottom + 1, new_bottom, col_first, col_last);
+
+            pos.y = wall <= new_bottom ? wall * tile_size - size.y : pos.y + delta.y;
+        }
         else
-            wall_dist = (map_pos.y - pos.y + (1 - step_y) / 2) / dir.y;
+        {
+            int wall = solid->findLastSolidInColumns(new_top, top - 1, col_first, col_last);
 
-        if (wall_dist > range / tile_size)
-            return range;
+            pos.y = wall >= new_top ? (wall + 1) * tile_size : pos.y + delta.y;
+        }
     }
 
-    return wall_dist * tile_size;
+    return pos;
+}
+
+// Most moves are shorter than a tile and far from walls: when no tile of the
+// box before and after the move is solid, none on the way is either. That is
+// checked first, without branching on the direction of the move (as random as
+// the entities of a tick are), so that sweeps stay as cheap as the two-corner
+// check they replaced (see bench/collision_bench.cpp).
+Vec2f sweepBox(Vec2f pos, Vec2f size, Vec2f delta, const TilemapDesc *map)
+{
+    const float inv_tile_size = 1.0f / (float)(map->tile_size * map->scale);
+
+    // same sums as the scans (the far side of the box is pos + size + delta,
+    // or pos + delta + size once x moved) so that rounding can't leave a tile
+    // out
+    Vec2f end = pos + delta;
+    Vec2f far_start = pos + size;
+    Vec2f far_end = far_start + delta;
+    Vec2f far_moved = end + size;
+    float min_x = end.x < pos.x ? end.x : pos.x;
+    float min_y = end.y < pos.y ? end.y : pos.y;
+    float max_x = far_end.x > far_start.x ? far_end.x : far_start.x;
+    float max_y = far_end.y > far_start.y ? far_end.y : far_start.y;
+    max_x = far_moved.x > max_x ? far_moved.x : max_x;
+    if (map->collisions->isSmallAreaEmpty(firstTileOf(min_x, inv_tile_size), firstTileOf(min_y, inv_tile_size),
+                                          lastTileOf(max_x - SWEEP_EPSILON, inv_tile_size), lastTileOf(max_y - SWEEP_EPSILON, inv_tile_size)))
+        return end;
+
+    return sweepBoxScan(pos, size, delta, map);
 }
 
 // collisions taken from HaxeFlixel engine
@@ -0,0 +1,141 @@
+#include "engine/collision_map.h"
+
+static int strideOf(int n)
+{
+    return (n + 2 + 63) / 64;
+}
+
+CollisionMap::CollisionMap(const int width, const int height) : width(width), height(height), regions_x(0)
+{
+    row_stride = strideOf(width);
+    column_stride = strideOf(height);
+    storage.assign(rowDataSize() + columnDataSize(), 0);
+    rows = storage.data();
+    columns = storage.data() + rowDataSize();
+
+    for (int x = -1; x <= width; x++)
+    {
+        set(x, -1);
+        set(x, height);
+    }
+    for (int y = 0; y < height; y++)
+    {
+        set(-1, y);
+        set(width, y);
+    }
+}
+
+CollisionMap::CollisionMap(const int width, const int height, uint64_t *rows, uint64_t *columns)
+    : width(width), height(height), rows(rows), columns(columns), regions_x(0)
+{
+    row_stride = strideOf(width);
+    column_stride = strideOf(height);
+}
+
+size_t CollisionMap::rowDataSize() const { return (size_t)row_stride * (height + 2); }
+
+size_t CollisionMap::columnDataSize() const { return (size_t)column_stride * (width + 2); }
+
+int scanLinesForward(const uint64_t *lines, const size_t stride, const int l0, const int l1, const int b0, const int b1)
+{
+    for (int w = b0 >> 6; w <= b1 >> 6; w++)
+    {
+        uint64_t word = 0;
+        for (int l = l0; l <= l1; l++)
+            word |= lines[(size_t)l * stride + w];
+        if (w == b0 >> 6)
+            word &= ~(uint64_t)0 << (b0 & 63);
+        if (w == b1 >> 6)
+            word &= ~(uint64_t)0 >> (63 - (b1 & 63));
+        if (word)
+            return (w << 6) + countTrailingZeros64(word);
+    }
+    return b1 + 1;
+}
+
+int scanLinesBackward(const uint64_t *lines, const size_t stride, const int l0, const int l1, const int b0, const int b1)
+{
+    for (int w = b1 >> 6; w >= b0 >> 6; w--)
+    {
+        uint64_t word = 0;
+        for (int l = l0; l <= l1; l++)
+            word |= lines[(size_t)l * stride + w];
+        if (w == b0 >> 6)
+            word &= ~(uint64_t)0 << (b0 & 63);
+        if (w == b1 >> 6)
+            word &= ~(uint64_t)0 >> (63 - (b1 & 63));
+        if (word)
+            return (w << 6) + highestBit64(word);
+    }
+    return b0 - 1;
+}
+
+void CollisionMap::set(const int x, const int y, const bool solid)
+{
+    int row_bit = x + 1;
+    int column_bit = y + 1;
+    uint64_t &row_word = rows[(size_t)(y + 1) * row_stride + (row_bit >> 6)];
+    uint64_t &column_word = columns[(size_t)(x + 1) * column_stride + (column_bit >> 6)];
+
+    if (solid)
+    {
+        row_word |= (uint64_t)1 << (row_bit & 63);
+        column_word |= (uint64_t)1 << (column_bit & 63);
+    }
+    else
+    {
+        row_word &= ~((uint64_t)1 << (row_bit & 63));
+        column_word &= ~((uint64_t)1 << (column_bit & 63));
+    }
+
+    if (region_states.empty() || x < 0 || x >= width || y < 0 || y >= height)
+        return;
+
+    int rx = x >> REGION_SHIFT;
+    int ry = y >> REGION_SHIFT;
+    region_states[(size_t)ry * regions_x + rx] = computeRegionState(rx, ry);
+}
+
+RegionState CollisionMap::computeRegionState(const int rx, const int ry) const
+{
+    int x0 = rx << REGION_SHIFT;
+    int x1 = x0 + REGION_SIZE > width ? width : x0 + REGION_SIZE;
+    int y0 = ry << REGION_SHIFT;
+    int y1 = y0 + REGION_SIZE > height ? height : y0 + REGION_SIZE;
+
+    // tiles [x0, x1) are bits [x0 + 1, x1] of a row
+    int b0 = x0 + 1;
+    int b1 = x1;
+    uint64_t first_mask = ~(uint64_t)0 << (b0 & 63);
+    uint64_t last_mask = ~(uint64_t)0 >> (63 - (b1 & 63));
+
+    bool any_solid = false;
+    bool any_empty = false;
+    for (int y = y0; y < y1 && !(any_solid && any_empty); y++)
+    {
+        const uint64_t *row = &rows[(size_t)(y + 1) * row_stride];
+        for (int w = b0 >> 6; w <= b1 >> 6; w++)
+        {
+            uint64_t mask = ~(uint64_t)0;
+            if (w == b0 >> 6)
+                mask &= first_mask;
+            if (w == b1 >> 6)
+                mask &= last_mask;
+            any_solid |= (row[w] & mask) != 0;
+            any_empty |= (row[w] & mask) != mask;
+        }
+    }
+
+    return any_solid && any_empty ? REGION_MIXED : any_solid ? REGION_SOLID : REGION_EMPTY;
+}
+
+void CollisionMap::summarize()
+{
+    const int regions_y = (height + REGION_SIZE - 1) >> REGION_SHIFT;
+    regions_x = (width + REGION_SIZE - 1) >> REGION_SHIFT;
+    region_states.assign((size_t)regions_x * regions_y, REGION_EMPTY);
+
+    for (int ry = 0; ry < regions_y; ry++)
+        for (int rx = 0; rx < regions_x; rx++)
+            region_states[(size_t)ry * regions_x + rx] = computeRegionState(rx, ry);
+}
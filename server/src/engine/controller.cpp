@@ -1,51 +1,55 @@
 #include "engine/controller.h"
 
+#include <cmath>
+
 #include "loguru/loguru.hpp"
 
 #include "engine/game_config.h"
 #include "engine/ai.h"
 
-Controller::Controller() : control_history(ACK_SIZE * 8){};
+Controller::Controller(){};
 
-void Controller::registerControl(Control &ctrl)
+void Controller::reset()
 {
-    if (!control_history.mem(ctrl.tick))
-        control_history.write(ctrl.tick, ctrl);
-    else
-        LOG_F(WARNING, "control %d already exists (discarded)", ctrl.tick);
+    control_history.clear();
+    last_ctrl_tick = -1;
+    last_call_tick = 0;
 }
 
-Control *Controller::getNextControl(tick_t from)
+bool Controller::registerControl(Control &ctrl)
 {
-    if (control_history.size() <= 0)
-        return nullptr;
+    // controls are sent several times, the first copy is kept
+    if (control_history.mem(ctrl.tick))
+        return false;
 
-    tick_t last_tick_received = control_history.get(0)->tick;
+    control_history.write(ctrl.tick, ctrl);
+    return true;
+}
 
-    if (from > last_tick_received)
+Control *Controller::getNextControl(tick_t from)
+{
+    int id = control_history.findNextPresent(from);
+    if (id < 0)
         return nullptr;
 
-    while (!control_history.mem(from) && from < last_tick_received)
-        from++;
-
-    return control_history.getById(from);
+    return control_history.getById(id);
 }
 
-const std::vector<Control *> Controller::getControls(tick_t current_tick)
+void Controller::getControls(tick_t current_tick, ControlList &out)
 {
-    std::vector<Control *> res;
+    out.clear();
 
     if (last_ctrl_tick == 0)
         // no control yet
         if (control_history.size() == 0)
-            return res;
+            return;
         else
         {
             Control *ctrl = control_history.get(0);
             last_ctrl_tick = ctrl->tick;
             last_call_tick = current_tick;
-            res.push_back(ctrl);
-            return res;
+            out.push_back(ctrl);
+            return;
         }
 
     // time advanced since last call ?
@@ -55,9 +59,9 @@ const std::vector<Control *> Controller::getControls(tick_t current_tick)
         // number of ticks elapsed since last call, this is the max number of ticks to process
         tick_t n_ticks = current_tick - last_call_tick;
 
-        // read at most n_ticks ticks and store them in res
+        // read at most n_ticks ticks and store them in out
         tick_t aux = last_ctrl_tick;
-        for (tick_t i = 0; i < n_ticks; i++)
+        for (tick_t i = 0; i < n_ticks && !out.full(); i++)
         {
             // returns nullptr if no control available
             Control *next_ctrl = getNextControl(aux + 1);
@@ -65,26 +69,167 @@ const std::vector<Control *> Controller::getControls(tick_t current_tick)
             if (!next_ctrl)
                 break;
 
-            res.push_back(next_ctrl);
+            out.push_back(next_ctrl);
             aux = next_ctrl->tick;
         }
 
         last_ctrl_tick = aux;
     }
 
-    if (res.size() > 0)
+    if (out.size() > 0)
         last_call_tick = current_tick;
+}
+
+PlayerController::PlayerController() : Controller(){};
+
+void PlayerController::reset()
+{
+    Controller::reset();
+    has_transit = false;
+    transit_mean = 0;
+    transit_dev = 0;
+    delay = 0;
+    playout_tick = -1;
+    metrics = {};
+}
+
+void PlayerController::measureArrival(tick_t ctrl_tick, tick_t arrival_tick)
+{
+    if (playout_tick >= 0 && ctrl_tick <= playout_tick)
+        metrics.late++;
+
+    float transit = (float)(arrival_tick - ctrl_tick);
+    if (!has_transit)
+    {
+        transit_mean = transit;
+        transit_dev = 0;
+        has_transit = true;
+    }
+    else
+    {
+        float deviation = fabsf(transit - transit_mean);
+        transit_mean += (transit - transit_mean) * JITTER_GAIN;
+        transit_dev += (deviation - transit_dev) * JITTER_GAIN;
+    }
+
+    updateDelay();
+}
+
+void PlayerController::updateDelay()
+{
+    float margin = JITTER_K * transit_dev;
+    margin = margin < JITTER_MIN_MARGIN ? JITTER_MIN_MARGIN : margin;
+    margin = margin > JITTER_MAX_MARGIN ? JITTER_MAX_MARGIN : margin;
+    float target = transit_mean + margin;
+
+    // a longer delay holds the controls for a few ticks, a shorter one
+    // doubles one: it only goes down when clearly too long, a tick at a time
+    if (target > (float)delay)
+        delay = (tick_t)ceilf(target);
+    else if (target < (float)delay - JITTER_HYSTERESIS)
+        delay--;
+}
+
+void PlayerController::getControls(tick_t current_tick, ControlList &out)
+{
+    out.clear();
+
+    if (!has_transit || control_history.size() == 0)
+        return;
+
+    // the control of `target` is due this tick
+    tick_t target = current_tick - delay;
+    if (playout_tick < 0 || target - playout_tick > MAX_CONTROLS_PER_UPDATE)
+        // first control, or too far behind: start over from the due one
+        playout_tick = target - 1;
 
+    // nothing when the delay has just grown, two when it has just shrunk,
+    // one per tick otherwise
+    while (playout_tick < target)
+    {
+        playout_tick++;
+
+        Control *ctrl = control_history.getById(playout_tick);
+        if (ctrl)
+        {
+            out.push_back(ctrl);
+            metrics.released++;
+        }
+        else
+            metrics.underruns++;
+    }
+
+    // held: received but not played yet
+    int depth = control_history.getHeadId() - playout_tick;
+    depth = depth > 0 ? depth : 0;
+    metrics.depth_sum += depth;
+    if (depth > metrics.max_depth)
+        metrics.max_depth = depth;
+
+    last_ctrl_tick = playout_tick;
+    last_call_tick = current_tick;
+}
+
+InputMetrics PlayerController::collectMetrics()
+{
+    InputMetrics res = metrics;
+    metrics = {};
     return res;
 }
 
-PlayerController::PlayerController() : Controller(){};
+AIController::AIController(std::shared_ptr<AI> ai)
+{
+    setAI(ai);
+}
+
+void AIController::setAI(std::shared_ptr<AI> ai)
+{
+    if (this->ai)
+        this->ai->detach(state);
+    state = AIState();
+
+    this->ai = ai;
+    if (ai)
+        ai->attach(state);
+}
+
+void AIController::reset()
+{
+    Controller::reset();
+    if (ai)
+        ai->detach(state);
+    state = AIState();
+    has_control = false;
+    scheduled = false;
+    next_think = 0;
+    combat_until = 0;
+    last_health = 0;
+}
 
-AIController::AIController(std::shared_ptr<AI> ai) : ai(ai) {}
+void AIController::think(Entity *entity)
+{
+    if (!ai)
+        return;
+
+    state.percept.valid = false; // no perception stage, the AI looks by itself
+    setControl(ai->makeNextControl(entity, state));
+}
+
+void AIController::setControl(const Control &ctrl)
+{
+    last_control = ctrl;
+    has_control = true;
+}
 
 void AIController::update(Entity *entity, tick_t current_tick)
 {
-    Control ctrl = ai->makeNextControl(entity);
+    if (!scheduled)
+        think(entity);
+
+    if (!has_control)
+        return;
+
+    Control ctrl = last_control;
     ctrl.tick = current_tick;
 
     // LOG_F(INFO, "tick %d, other move:%s%s%s%s", current_tick,
@@ -94,4 +239,4 @@ void AIController::update(Entity *entity, tick_t current_tick)
     //       (RIGHT(ctrl.movement) ? " RIGHT" : ""));
 
     registerControl(ctrl);
-}
\ No newline at end of file
+}
@@ -0,0 +1,359 @@
+#include "engine/cooked_map.h"
+
+#include <fstream>
+#include <string.h>
+#include "loguru/loguru.hpp"
+
+#include "engine/tilemap.h"
+
+// bytes of the file being cooked
+struct CookWriter
+{
+    std::vector<char> bytes;
+
+    void putBytes(const void *data, size_t size)
+    {
+        const char *p = (const char *)data;
+        bytes.insert(bytes.end(), p, p + size);
+    }
+
+    template <typename T>
+    void put(const T &value) { putBytes(&value, sizeof(T)); }
+
+    void align()
+    {
+        while (bytes.size() % 8 != 0)
+            bytes.push_back(0);
+    }
+
+    CookedSection section(const void *data, size_t size)
+    {
+        align();
+        CookedSection s = {bytes.size(), size};
+        putBytes(data, size);
+        return s;
+    }
+};
+
+// reads a section, every read is bounds checked and `ok` goes false on the
+// first one that is out of it
+struct CookReader
+{
+    const char *p;
+    const char *end;
+    bool ok = true;
+
+    CookReader(const char *begin, size_t size) : p(begin), end(begin + size) {}
+
+    bool getBytes(void *out, size_t size)
+    {
+        if (!ok || (size_t)(end - p) < size)
+            return ok = false;
+        memcpy(out, p, size);
+        p += size;
+        return true;
+    }
+
+    template <typename T>
+    T get()
+    {
+        T value = T();
+        getBytes(&value, sizeof(T));
+        return value;
+    }
+};
+
+static void writeGroups(CookWriter &out, const std::vector<EnemyGroup> &enemy_groups, const std::vector<Group<SpawnPoint>> &spawn_points)
+{
+    out.put((uint32_t)enemy_groups.size());
+    for (const EnemyGroup &group : enemy_groups)
+    {
+        out.put((int32_t)group.id);
+        out.put((int32_t)group.rules.wave_size);
+        out.put(group.rules.wave_period);
+        out.put(group.rules.respawn_delay);
+
+        out.put((uint32_t)group.elts.size());
+        for (const Enemy &enemy : group.elts)
+        {
+            out.put((uint32_t)enemy.name.size());
+            out.putBytes(enemy.name.data(), enemy.name.size());
+            out.put(enemy.pos.x);
+            out.put(enemy.pos.y);
+            out.put((int32_t)enemy.difficulty);
+            out.put((int32_t)enemy.count);
+            out.put(enemy.spread);
+            out.put((uint32_t)enemy.behavior.size());
+            out.putBytes(enemy.behavior.data(), enemy.behavior.size());
+        }
+    }
+
+    out.put((uint32_t)spawn_points.size());
+    for (const Group<SpawnPoint> &group : spawn_points)
+    {
+        out.put((int32_t)group.id);
+        out.put((uint32_t)group.elts.size());
+        for (const SpawnPoint &spawn_point : group.elts)
+        {
+            out.put((int32_t)spawn_point.id);
+            out.put(spawn_point.pos.x);
+            out.put(spawn_point.pos.y);
+        }
+    }
+}
+
+static bool readGroups(CookReader &in, std::vector<EnemyGroup> &enemy_groups, std::vector<Group<SpawnPoint>> &spawn_points)
+{
+    uint32_t n_enemy_groups = in.get<uint32_t>();
+    for (uint32_t i = 0; i < n_enemy_groups && in.ok; i++)
+    {
+        EnemyGroup group;
+        group.id = in.get<int32_t>();
+        group.rules.wave_size = in.get<int32_t>();
+        group.rules.wave_period = in.get<float>();
+        group.rules.respawn_delay = in.get<float>();
+
+        uint32_t n_elts = in.get<uint32_t>();
+        for (uint32_t j = 0; j < n_elts && in.ok; j++)
+        {
+            Enemy enemy;
+            uint32_t name_len = in.get<uint32_t>();
+            if (name_len > (size_t)(in.end - in.p))
+                return false;
+            enemy.name.assign(in.p, name_len);
+            in.p += name_len;
+            enemy.pos.x = in.get<float>();
+            enemy.pos.y = in.get<float>();
+            enemy.difficulty = in.get<int32_t>();
+            enemy.count = in.get<int32_t>();
+            enemy.spread = in.get<float>();
+            uint32_t behavior_len = in.get<uint32_t>();
+            if (behavior_len > (size_t)(in.end - in.p))
+                return false;
+            enemy.behavior.assign(in.p, behavior_len);
+            in.p += behavior_len;
+            group.elts.push_back(enemy);
+        }
+        enemy_groups.push_back(group);
+    }
+
+    uint32_t n_spawn_groups = in.get<uint32_t>();
+    for (uint32_t i = 0; i < n_spawn_groups && in.ok; i++)
+    {
+        Group<SpawnPoint> group;
+        group.id = in.get<int32_t>();
+
+        uint32_t n_elts = in.get<uint32_t>();
+        for (uint32_t j = 0; j < n_elts && in.ok; j++)
+        {
+            SpawnPoint spawn_point;
+            spawn_point.id = in.get<int32_t>();
+            spawn_point.pos.x = in.get<float>();
+            spawn_point.pos.y = in.get<float>();
+            group.elts.push_back(spawn_point);
+        }
+        spawn_points.push_back(group);
+    }
+
+    return in.ok;
+}
+
+bool Map::cook(const char *path) const
+{
+    if (tilemap.width > COOKED_MAP_MAX_SIZE || tilemap.height > COOKED_MAP_MAX_SIZE ||
+        tileset.width > COOKED_MAP_MAX_SIZE || tileset.height > COOKED_MAP_MAX_SIZE)
+    {
+        LOG_F(ERROR, "map is too large to be cooked (at most %d * %d tiles)", COOKED_MAP_MAX_SIZE, COOKED_MAP_MAX_SIZE);
+        return false;
+    }
+
+    CookedMapHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COOKED_MAP_MAGIC, sizeof(header.magic));
+    header.version = COOKED_MAP_VERSION;
+    header.width = tilemap.width;
+    header.height = tilemap.height;
+    header.tile_size = tilemap.tile_size;
+    header.scale = tilemap.scale;
+    header.tileset_tile_size = tileset.tile_size;
+    header.tileset_width = tileset.width;
+    header.tileset_height = tileset.height;
+
+    // the header is patched once the sections are placed
+    CookWriter out;
+    out.put(header);
+
+    // uniform chunks are stored in the table only
+    const TileChunks *tiles = tilemap.tiles;
+    std::vector<CookedChunk> chunks;
+    CookWriter pages;
+    for (int cy = 0; cy < tiles->getChunksY(); cy++)
+        for (int cx = 0; cx < tiles->getChunksX(); cx++)
+        {
+            const TILE *page = tiles->getPage(cx, cy);
+            CookedChunk chunk = {tiles->getUniform(cx, cy), 0};
+            if (page)
+            {
+                chunk.page = (uint32_t)(pages.bytes.size() / (CHUNK_SIZE * CHUNK_SIZE * sizeof(TILE))) + 1;
+                pages.putBytes(page, CHUNK_SIZE * CHUNK_SIZE * sizeof(TILE));
+            }
+            chunks.push_back(chunk);
+        }
+    header.sections[COOKED_TILE_CHUNKS] = out.section(chunks.data(), chunks.size() * sizeof(CookedChunk));
+    header.sections[COOKED_TILE_PAGES] = out.section(pages.bytes.data(), pages.bytes.size());
+
+    const CollisionMap *collisions = tilemap.collisions;
+    header.sections[COOKED_COLLISION_ROWS] = out.section(collisions->rowData(), collisions->rowDataSize() * sizeof(uint64_t));
+    header.sections[COOKED_COLLISION_COLUMNS] = out.section(collisions->columnData(), collisions->columnDataSize() * sizeof(uint64_t));
+    header.sections[COOKED_CLEARANCE] = out.section(tilemap.clearance->data(), tilemap.clearance->dataSize());
+
+    std::vector<uint8_t> solid(tileset.solid->size());
+    for (int i = 0; i < (int)solid.size(); i++)
+        solid[i] = tileset.solid->get(i);
+    header.sections[COOKED_TILESET_SOLID] = out.section(solid.data(), solid.size());
+    header.sections[COOKED_TILESET_IMAGE] = out.section(tileset.data, tileset.data_len);
+
+    CookWriter groups;
+    writeGroups(groups, enemy_groups, spawn_points);
+    header.sections[COOKED_GROUPS] = out.section(groups.bytes.data(), groups.bytes.size());
+
+    memcpy(out.bytes.data(), &header, sizeof(header));
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(out.bytes.data(), out.bytes.size());
+    if (!file)
+    {
+        LOG_F(ERROR, "could not write cooked map %s", path);
+        return false;
+    }
+
+    LOG_F(INFO, "cooked map written to %s (%d bytes)", path, (int)out.bytes.size());
+    return true;
+}
+
+bool Map::loadCooked(const char *path)
+{
+    LOG_F(INFO, "mapping %s", path);
+
+    if (!file.open(path))
+        return false;
+
+    if (file.size() < sizeof(CookedMapHeader))
+    {
+        LOG_F(ERROR, "cooked map %s is truncated", path);
+        return false;
+    }
+
+    CookedMapHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, COOKED_MAP_MAGIC, sizeof(header.magic)) != 0)
+    {
+        LOG_F(ERROR, "%s is not a cooked map", path);
+        return false;
+    }
+    if (header.version != COOKED_MAP_VERSION)
+    {
+        LOG_F(ERROR, "cooked map %s has version %u, expected %u (cook it again)", path, header.version, COOKED_MAP_VERSION);
+        return false;
+    }
+    if (header.scale != tilemap.scale)
+    {
+        LOG_F(ERROR, "cooked map %s was cooked with scale %d, the server runs with %d", path, header.scale, tilemap.scale);
+        return false;
+    }
+
+    // the dimensions size the allocations below and the sections they are
+    // checked against
+    if (header.width < 1 || header.width > COOKED_MAP_MAX_SIZE || header.height < 1 || header.height > COOKED_MAP_MAX_SIZE ||
+        header.tileset_width < 0 || header.tileset_width > COOKED_MAP_MAX_SIZE || header.tileset_height < 0 || header.tileset_height > COOKED_MAP_MAX_SIZE ||
+        header.tile_size == 0 || header.tileset_tile_size == 0)
+    {
+        LOG_F(ERROR, "cooked map %s has corrupted dimensions (%d * %d tiles of %d, tileset of %d * %d)", path,
+              header.width, header.height, header.tile_size, header.tileset_width, header.tileset_height);
+        return false;
+    }
+
+    for (int i = 0; i < N_COOKED_SECTIONS; i++)
+    {
+        const CookedSection &s = header.sections[i];
+        if (s.offset % 8 != 0 || s.offset > file.size() || s.size > file.size() - s.offset)
+        {
+            LOG_F(ERROR, "cooked map %s has a corrupted section %d", path, i);
+            return false;
+        }
+    }
+
+    tilemap.width = header.width;
+    tilemap.height = header.height;
+    tilemap.tile_size = header.tile_size;
+    tileset.tile_size = header.tileset_tile_size;
+    tileset.width = header.tileset_width;
+    tileset.height = header.tileset_height;
+
+    LOG_F(INFO, "map grid dimension %d, %d, tile size %d * %hu", tilemap.width, tilemap.height, tilemap.tile_size, tilemap.scale);
+
+    // tiles, collisions and clearance are used in place
+    char *base = file.data();
+    const CookedSection *sections = header.sections;
+
+    tilemap.tiles = new TileChunks(tilemap.width, tilemap.height);
+    tilemap.collisions = new CollisionMap(tilemap.width, tilemap.height,
+                                          (uint64_t *)(base + sections[COOKED_COLLISION_ROWS].offset),
+                                          (uint64_t *)(base + sections[COOKED_COLLISION_COLUMNS].offset));
+    tilemap.clearance = new DistanceField();
+    tilemap.clearance->borrow(tilemap.width, tilemap.height, (const uint8_t *)(base + sections[COOKED_CLEARANCE].offset));
+
+    const size_t page_size = CHUNK_SIZE * CHUNK_SIZE * sizeof(TILE);
+    const size_t n_chunks = (size_t)tilemap.tiles->getChunksX() * tilemap.tiles->getChunksY();
+    if (sections[COOKED_TILE_CHUNKS].size != n_chunks * sizeof(CookedChunk) ||
+        sections[COOKED_TILE_PAGES].size % page_size != 0 ||
+        sections[COOKED_COLLISION_ROWS].size != tilemap.collisions->rowDataSize() * sizeof(uint64_t) ||
+        sections[COOKED_COLLISION_COLUMNS].size != tilemap.collisions->columnDataSize() * sizeof(uint64_t) ||
+        sections[COOKED_CLEARANCE].size != tilemap.clearance->dataSize() ||
+        sections[COOKED_TILESET_SOLID].size != (uint64_t)tileset.width * tileset.height)
+    {
+        // sections must be exactly as large as what the XML loader would allocate
+        LOG_F(ERROR, "cooked map %s does not match its dimensions", path);
+        return false;
+    }
+
+    const CookedChunk *chunks = (const CookedChunk *)(base + sections[COOKED_TILE_CHUNKS].offset);
+    const size_t n_pages = (size_t)sections[COOKED_TILE_PAGES].size / page_size;
+    for (int cy = 0; cy < tilemap.tiles->getChunksY(); cy++)
+        for (int cx = 0; cx < tilemap.tiles->getChunksX(); cx++)
+        {
+            const CookedChunk &chunk = chunks[(size_t)cy * tilemap.tiles->getChunksX() + cx];
+            if (chunk.page > n_pages)
+            {
+                LOG_F(ERROR, "cooked map %s has a corrupted chunk table", path);
+                return false;
+            }
+
+            tilemap.tiles->setUniform(cx, cy, chunk.uniform);
+            if (chunk.page > 0)
+                tilemap.tiles->borrowPage(cx, cy, (TILE *)(base + sections[COOKED_TILE_PAGES].offset + (chunk.page - 1) * page_size));
+        }
+
+    // a couple of bits per chunk, cheaper to compute than to store
+    tilemap.collisions->summarize();
+
+    // the tileset solid bits are tiny and only read by the XML loader, a copy
+    // keeps BitArray as it is
+    const uint8_t *solid = (const uint8_t *)(base + sections[COOKED_TILESET_SOLID].offset);
+    tileset.solid = new BitArray(tileset.width * tileset.height);
+    for (int i = 0; i < tileset.width * tileset.height; i++)
+        tileset.solid->set(i, solid[i] != 0);
+
+    tileset.data = base + sections[COOKED_TILESET_IMAGE].offset;
+    tileset.data_len = (size_t)sections[COOKED_TILESET_IMAGE].size;
+
+    CookReader groups(base + sections[COOKED_GROUPS].offset, (size_t)sections[COOKED_GROUPS].size);
+    if (!readGroups(groups, enemy_groups, spawn_points))
+    {
+        LOG_F(ERROR, "cooked map %s has corrupted object groups", path);
+        return false;
+    }
+
+    LOG_F(INFO, "loaded %d enemy groups and %d spawn groups", (int)enemy_groups.size(), (int)spawn_points.size());
+    return true;
+}
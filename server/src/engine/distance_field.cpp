@@ -0,0 +1,77 @@
+#include "engine/distance_field.h"
+
+#include "engine/collision_map.h"
+
+DistanceField::DistanceField() : width(0), height(0), stride(2), field(nullptr) {}
+
+void DistanceField::borrow(const int width, const int height, const uint8_t *data)
+{
+    this->width = width;
+    this->height = height;
+    stride = width + 2;
+    storage.clear();
+    field = data;
+}
+
+void DistanceField::build(const CollisionMap &collisions)
+{
+    width = collisions.getWidth();
+    height = collisions.getHeight();
+    stride = width + 2;
+    storage.assign(dataSize(), 0);
+    field = storage.data();
+
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            storage[(size_t)(y + 1) * stride + x + 1] = collisions.get(x, y) ? 0 : MAX_CLEARANCE;
+
+    // the border stays at 0, so the passes only run over the inside of the map
+
+    // forward pass: neighbours above and on the left
+    for (int y = 1; y <= height; y++)
+    {
+        uint8_t *row = &storage[(size_t)y * stride];
+        const uint8_t *up = row - stride;
+        for (int x = 1; x <= width; x++)
+        {
+            int d = row[x];
+            if (d == 0)
+                continue;
+
+            int n = row[x - 1];
+            if (up[x - 1] < n)
+                n = up[x - 1];
+            if (up[x] < n)
+                n = up[x];
+            if (up[x + 1] < n)
+                n = up[x + 1];
+
+            if (n + 1 < d)
+                row[x] = (uint8_t)(n + 1);
+        }
+    }
+
+    // backward pass: neighbours below and on the right
+    for (int y = height; y >= 1; y--)
+    {
+        uint8_t *row = &storage[(size_t)y * stride];
+        const uint8_t *down = row + stride;
+        for (int x = width; x >= 1; x--)
+        {
+            int d = row[x];
+            if (d == 0)
+                continue;
+
+            int n = row[x + 1];
+            if (down[x - 1] < n)
+                n = down[x - 1];
+            if (down[x] < n)
+                n = down[x];
+            if (down[x + 1] < n)
+                n = down[x + 1];
+
+            if (n + 1 < d)
+                row[x] = (uint8_t)(n + 1);
+        }
+    }
+}
@@ -1 +1,15 @@
-#include "engine/enemy.h"
\ No newline at end of file
+#include "engine/enemy.h"
+
+NPC::NPC() : Entity(-1, CONTROLLED_ENTITY, "__npc__", 100, nullptr)
+{
+    controller = &ai_controller;
+    owns_controller = false;
+    type = PLAYER; // drawn like players by the client
+}
+
+void NPC::reset(ID id, std::string name, const Vec2f pos, std::shared_ptr<AI> ai, float max_health)
+{
+    Entity::reset(id, name, max_health);
+    ai_controller.setAI(ai);
+    place(pos);
+}
@@ -69,6 +69,9 @@ Entity::Entity(ID id = -1, EntityType type, std::string name, float max_health,
     else
         this->id = id;
 
+    this->name.reserve(NAME_SIZE);
+    weapons.reserve(MAX_N_WEAPONS);
+
     setName(name);
 
     if (!Weapons::get(0, &equipped_weapon))
@@ -79,10 +82,34 @@ Entity::Entity(ID id = -1, EntityType type, std::string name, float max_health,
 
 Entity::~Entity()
 {
-    if (controller)
+    if (controller && owns_controller)
         delete controller;
 }
 
+void Entity::reset(ID id, std::string name, float max_health)
+{
+    this->id = id < 0 ? freshID() : id;
+    setName(name);
+
+    this->max_health = max_health;
+    health = max_health;
+    alive = true;
+
+    pos = Vec2f();
+    last_pos = Vec2f();
+    facing_angle = 0;
+    running = false;
+    want_shoot = false;
+    tick_next_shoot = 0;
+    random_generator.setSeed(1);
+
+    if (controller)
+        controller->reset();
+
+    weapons.clear();
+    pickWeapon(0);
+}
+
 void Entity::setName(const std::string name)
 {
     if (name.size() <= NAME_SIZE)
@@ -188,29 +215,10 @@ const Vec2f Entity::bottomright() const
 
 void Entity::doMapCollisions(const TilemapDesc *map)
 {
-    int tile_size = map->tile_size * map->scale;
-    Vec2i tile_topleft = map->xyOfWorldPos(topleft());
-    if (map->getSolid(tile_topleft))
-    {
-        Vec2f pos_tile = map->worldPosOfXY(tile_topleft);
-        float overlapX = computeOverlapX(pos, last_pos, Vec2f(2 * radius, 2 * radius), pos_tile, pos_tile, Vec2f((float)tile_size, (float)tile_size));
-        pos.x -= overlapX;
-        float overlapY = computeOverlapY(pos, last_pos, Vec2f(2 * radius, 2 * radius), pos_tile, pos_tile, Vec2f((float)tile_size, (float)tile_size));
-        pos.y -= overlapY;
-    }
-
-    Vec2i tile_bottomright = map->xyOfWorldPos(bottomright());
-    if (map->getSolid(tile_bottomright))
-    {
-        Vec2f pos_tile = map->worldPosOfXY(tile_bottomright);
-        float overlapX = computeOverlapX(pos, last_pos, Vec2f(2 * radius, 2 * radius), pos_tile, pos_tile, Vec2f((float)tile_size, (float)tile_size));
-        pos.x -= overlapX;
-        float overlapY = computeOverlapY(pos, last_pos, Vec2f(2 * radius, 2 * radius), pos_tile, pos_tile, Vec2f((float)tile_size, (float)tile_size));
-        pos.y -= overlapY;
-    }
+    pos = sweepBox(last_pos, Vec2f(2 * radius, 2 * radius), pos - last_pos, map);
 }
 
-void Entity::applyControl(const Control *ctrl)
+void Entity::applyMovement(const Control *ctrl)
 {
     running = ctrl->run;
 
@@ -227,6 +235,11 @@ void Entity::applyControl(const Control *ctrl)
 
     if (aux_norm > 0)
         move(Vec2f(aux_x * vel / aux_norm, aux_y * vel / aux_norm));
+}
+
+void Entity::applyControl(const Control *ctrl)
+{
+    applyMovement(ctrl);
 
     if (ctrl->change_weapon)
     {
@@ -253,21 +266,25 @@ void Entity::pickWeapon(WEAPON_ID id)
     Weapons::get(id, &equipped_weapon);
 }
 
-const std::vector<Control *> Entity::update(const tick_t current_tick, const TilemapDesc *map)
+void Entity::update(const tick_t current_tick, const TilemapDesc *map, ControlList &ctrls)
 {
+    ctrls.clear();
     if (!controller)
-        return std::vector<Control *>();
+        return;
 
     controller->update(this, current_tick);
-    std::vector<Control *> ctrls = controller->getControls(current_tick);
+    controller->getControls(current_tick, ctrls);
 
+    Vec2f start = pos;
     for (Control *ctrl : ctrls)
-    {
         applyControl(ctrl);
+
+    // one sweep for the whole movement of this tick
+    if (ctrls.size() > 0)
+    {
+        last_pos = start;
         doMapCollisions(map);
     }
-
-    return ctrls;
 }
 
 bool Entity::canShoot(tick_t current_tick)
@@ -283,6 +300,7 @@ void Entity::configBullet(Bullet *bullet)
     bullet->owner = id;
     bullet->pos = pos;
     bullet->angle = facing_angle + random_noise;
+    bullet->dir = Vec2f(cosf(bullet->angle), sinf(bullet->angle));
     bullet->damage = equipped_weapon.damage;
     bullet->range = equipped_weapon.range;
 }
@@ -0,0 +1,242 @@
+#include "engine/flow_field.h"
+
+#include "engine/collision_map.h"
+
+// straight neighbours first, so that they win ties against diagonals
+static const int NEIGHBOUR_X[8] = {1, -1, 0, 0, 1, 1, -1, -1};
+static const int NEIGHBOUR_Y[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+
+// resetting a tile is much cheaper than expanding one
+#define RESET_TILES_PER_UNIT 8
+
+FlowField::FlowField(const CollisionMap *collisions)
+    : collisions(collisions), width(collisions->getWidth()), height(collisions->getHeight()), stride(width + 2),
+      front_target(-1, -1), back_target(-1, -1), wanted_target(-1, -1), origin(FLOW_ORIGIN), drift(0),
+      searching(false), reset_rows(0), queue_head(0), queue_tail(0)
+{
+}
+
+void FlowField::retarget(const Vec2i target)
+{
+    if (target.x < 0 || target.x >= width || target.y < 0 || target.y >= height || collisions->get(target.x, target.y))
+        return;
+
+    wanted_target = target;
+}
+
+bool FlowField::needsSearch() const
+{
+    if (wanted_target.x < 0)
+        return false;
+    if (front.empty() || drift >= FLOW_REPAIR_MAX_DRIFT)
+        return true;
+    return (wanted_target.x != front_target.x || wanted_target.y != front_target.y) && !canRepair();
+}
+
+// steps from `target` to the target of a field, bounded by the stored values,
+// -1 if the field does not reach it
+static int stepsTo(const std::vector<uint16_t> &field, const int stride, const int origin, const Vec2i target)
+{
+    uint16_t d = field[(size_t)(target.y + 1) * stride + target.x + 1];
+    return d < FLOW_WALL ? d - origin : -1;
+}
+
+bool FlowField::canRepair() const
+{
+    if (front.empty() || wanted_target.x < 0 || (wanted_target.x == front_target.x && wanted_target.y == front_target.y))
+        return false;
+
+    int moved = stepsTo(front, stride, origin, wanted_target);
+    return moved >= 0 && moved <= FLOW_REPAIR_MAX_DRIFT && moved <= origin;
+}
+
+int FlowField::repair()
+{
+    // every stored value was at least origin + the old distance, which is at
+    // least the new distance minus `moved`: lowering the origin by `moved`
+    // keeps them above the new distances, so a breadth first search from the
+    // new target only lowers values. It can stop at any radius of at least
+    // `moved`, the old target must get a smaller neighbour.
+    const int tx = wanted_target.x;
+    const int ty = wanted_target.y;
+    const int moved = stepsTo(front, stride, origin, wanted_target);
+    const int radius = moved > FLOW_REPAIR_RADIUS ? moved : FLOW_REPAIR_RADIUS;
+    origin -= moved;
+    drift += moved;
+    front_target = wanted_target;
+
+    // tiles at most `radius` steps away are in the box, whose tile (bx, by)
+    // is (tx - radius + bx, ty - radius + by)
+    const int side = 2 * radius + 1;
+    repair_seen.assign((size_t)side * side, 0);
+    repair_queue.resize((size_t)side * side);
+
+    int head = 0;
+    int tail = 0;
+    int *q = repair_queue.data();
+    uint16_t *dist = front.data();
+    q[tail++] = radius * side + radius;
+    repair_seen[radius * side + radius] = 1;
+    dist[(size_t)(ty + 1) * stride + tx + 1] = (uint16_t)origin;
+
+    while (head < tail)
+    {
+        int b = q[head++];
+        int bx = b % side;
+        int by = b / side;
+        int i = (ty - radius + by + 1) * stride + tx - radius + bx + 1;
+        int d = dist[i];
+        if (d - origin >= radius)
+            continue;
+
+        // tiles closer than the radius are in the map, their neighbours
+        // at most on the border and in the box
+        for (int k = 0; k < 8; k++)
+        {
+            int nb = b + NEIGHBOUR_Y[k] * side + NEIGHBOUR_X[k];
+            int n = i + NEIGHBOUR_Y[k] * stride + NEIGHBOUR_X[k];
+            if (repair_seen[nb] || dist[n] == FLOW_WALL)
+                continue;
+            if (k >= 4 && (dist[i + NEIGHBOUR_X[k]] == FLOW_WALL || dist[i + NEIGHBOUR_Y[k] * stride] == FLOW_WALL))
+                continue;
+
+            repair_seen[nb] = 1;
+            dist[n] = (uint16_t)(d + 1);
+            q[tail++] = nb;
+        }
+    }
+
+    return tail;
+}
+
+void FlowField::start()
+{
+    // same size every time, so this only allocates for the first searches
+    back.resize((size_t)stride * (height + 2));
+
+    back_target = wanted_target;
+    reset_rows = 0;
+    queue_head = 0;
+    queue_tail = 0;
+    searching = true;
+}
+
+// walls and unreached tiles, from the collision map (border included)
+int FlowField::resetRows(int budget)
+{
+    int work = 0;
+    while (reset_rows < height + 2 && work < budget)
+    {
+        // with the padding of both, tile x is bit x + 1 of the collision row
+        // and entry x + 1 of ours
+        const uint64_t *line = collisions->rowData() + (size_t)reset_rows * collisions->rowStride();
+        uint16_t *row = &back[(size_t)reset_rows * stride];
+        for (int b = 0; b < stride; b++)
+            row[b] = (line[b >> 6] >> (b & 63)) & 1 ? FLOW_WALL : FLOW_UNREACHED;
+
+        reset_rows++;
+        work += stride / RESET_TILES_PER_UNIT + 1;
+    }
+    return work;
+}
+
+int FlowField::step(int budget, std::vector<int> &queue)
+{
+    if (!searching)
+    {
+        if (!needsSearch())
+            return 0;
+        start();
+    }
+
+    int work = 0;
+    if (reset_rows < height + 2)
+    {
+        work += resetRows(budget);
+        if (reset_rows < height + 2)
+            return work;
+
+        queue.resize((size_t)width * height);
+        int t = (back_target.y + 1) * stride + back_target.x + 1;
+        back[t] = FLOW_ORIGIN;
+        queue[queue_tail++] = t;
+    }
+
+    int offset[8];
+    for (int k = 0; k < 8; k++)
+        offset[k] = NEIGHBOUR_Y[k] * stride + NEIGHBOUR_X[k];
+
+    uint16_t *dist = back.data();
+    int *q = queue.data();
+    while (queue_head < queue_tail && work < budget)
+    {
+        int i = q[queue_head++];
+        int d = dist[i];
+        work++;
+
+        if (d >= FLOW_MAX_DIST)
+            continue;
+
+        for (int k = 0; k < 8; k++)
+        {
+            int n = i + offset[k];
+            if (dist[n] != FLOW_UNREACHED)
+                continue;
+            // a diagonal step needs both tiles it cuts through to be free
+            if (k >= 4 && (dist[i + NEIGHBOUR_X[k]] == FLOW_WALL || dist[i + NEIGHBOUR_Y[k] * stride] == FLOW_WALL))
+                continue;
+
+            dist[n] = (uint16_t)(d + 1);
+            q[queue_tail++] = n;
+        }
+    }
+
+    if (queue_head == queue_tail)
+    {
+        // the target may have moved meanwhile: the new field replaces the
+        // repaired one if the next repair leaves it closer to exact, else it
+        // is dropped (a search starts again, to the latest target)
+        int moved = stepsTo(back, stride, FLOW_ORIGIN, wanted_target);
+        bool front_reaches = !front.empty() && stepsTo(front, stride, origin, wanted_target) >= 0;
+        if (!front_reaches || (moved >= 0 && moved < drift && moved <= FLOW_REPAIR_MAX_DRIFT))
+        {
+            std::swap(front, back);
+            front_target = back_target;
+            origin = FLOW_ORIGIN;
+            drift = 0;
+        }
+        searching = false;
+    }
+
+    return work;
+}
+
+bool FlowField::getNextTile(const int x, const int y, Vec2i *next) const
+{
+    if (front.empty() || x < 0 || x >= width || y < 0 || y >= height)
+        return false;
+
+    // stored values, only their order matters
+    uint16_t best = front[(size_t)(y + 1) * stride + x + 1];
+    if (best >= FLOW_WALL || best == origin)
+        return false;
+
+    // (x, y) is in the map, its neighbours are at most on the border
+    int i = (y + 1) * stride + x + 1;
+    bool found = false;
+    for (int k = 0; k < 8; k++)
+    {
+        int n = i + NEIGHBOUR_Y[k] * stride + NEIGHBOUR_X[k];
+        uint16_t d = front[n];
+        if (d >= best)
+            continue;
+        if (k >= 4 && (front[i + NEIGHBOUR_X[k]] == FLOW_WALL || front[i + NEIGHBOUR_Y[k] * stride] == FLOW_WALL))
+            continue;
+
+        best = d;
+        *next = Vec2i(x + NEIGHBOUR_X[k], y + NEIGHBOUR_Y[k]);
+        found = true;
+    }
+
+    return found;
+}
@@ -0,0 +1,523 @@
+#include "engine/match.h"
+
+#include <chrono>
+#include "loguru/loguru.hpp"
+
+#include "common/scheduler.h"
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "engine/game_config.h"
+#include "engine/tilemap.h"
+
+static void pinThread(std::thread &thread, int cpu)
+{
+    if (cpu < 0)
+        return;
+
+#if defined(_WIN32)
+    if (SetThreadAffinityMask(thread.native_handle(), (DWORD_PTR)1 << cpu) == 0)
+        LOG_F(WARNING, "could not pin thread to cpu %d", cpu);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) != 0)
+        LOG_F(WARNING, "could not pin thread to cpu %d", cpu);
+#endif
+}
+
+// in 64 bits, client_tick * SERVER_RATE overflows a tick_t after a few weeks
+static tick_t serverTickOf(tick_t client_tick)
+{
+    return (tick_t)((int64_t)client_tick * SERVER_RATE / CLIENT_RATE);
+}
+
+static double msSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+const char *const MATCH_PHASE_NAMES[N_MATCH_PHASES] = {"inbox", "update", "snapshot", "encode", "send"};
+
+Match::Match(int id, Map *map, UDPServer *network, int cpu) : id(id), world(map), map(map), network(network), running(false), cpu(cpu), profiler(MATCH_PHASE_NAMES, N_MATCH_PHASES)
+{
+    metrics = {};
+    metrics.match_id = id;
+}
+
+Match::~Match()
+{
+    stop();
+}
+
+void Match::start()
+{
+    if (running)
+        return;
+
+    running = true;
+    thread = std::thread(&Match::run, this);
+    pinThread(thread, cpu);
+
+    LOG_F(INFO, "match %d started", id);
+}
+
+void Match::stop()
+{
+    if (!running)
+        return;
+
+    running = false;
+    if (thread.joinable())
+        thread.join();
+
+    LOG_F(INFO, "match %d stopped", id);
+}
+
+void Match::push(const NetworkFrame &frame)
+{
+    std::lock_guard<std::mutex> lock(inbox_mutex);
+    inbox.push(frame);
+}
+
+void Match::dropPeer(const ID id)
+{
+    std::lock_guard<std::mutex> lock(inbox_mutex);
+    lost_peers.push_back(id);
+}
+
+void Match::answerJoin(const ID id, const bool accepted)
+{
+    std::lock_guard<std::mutex> lock(inbox_mutex);
+    if (accepted)
+        accepted_peers.push_back(id);
+    else
+        rejected_peers.push_back(id);
+}
+
+void Match::takeJoins(std::vector<ID> &accepted, std::vector<ID> &rejected)
+{
+    accepted.clear();
+    rejected.clear();
+
+    std::lock_guard<std::mutex> lock(inbox_mutex);
+    std::swap(accepted, accepted_peers);
+    std::swap(rejected, rejected_peers);
+}
+
+MatchMetrics Match::collectMetrics()
+{
+    std::lock_guard<std::mutex> lock(metrics_mutex);
+
+    MatchMetrics res = metrics;
+    if (res.n_wakeups > 0)
+        res.mean_tick_ms /= res.n_wakeups;
+    res.jitter_p50 = jitter.percentile(50);
+    res.jitter_p99 = jitter.percentile(99);
+    res.jitter_max = jitter.maxValue();
+    profiler.collect(res.phases);
+
+    metrics.n_ticks = 0;
+    metrics.n_wakeups = 0;
+    metrics.mean_tick_ms = 0;
+    metrics.max_tick_ms = 0;
+    metrics.missed_server_ticks = 0;
+    metrics.dropped_ticks = 0;
+    metrics.ai_thinks = 0;
+    metrics.ai_postponed = 0;
+    metrics.ai_over_budget = 0;
+    metrics.ai_max_think_us = 0;
+    metrics.input = {};
+    jitter.reset();
+
+    return res;
+}
+
+void Match::handleFrame(const NetworkFrame &frame)
+{
+    switch (frame.opcode())
+    {
+    case OP_CONTROL_FRAME:
+    {
+        Player *player = world.getPlayerById(frame.sender);
+        if (!player)
+        {
+            LOG_F(ERROR, "[match:%d] cannot find player with id %d", id, frame.sender);
+            return;
+        }
+
+        ControlFrame ctrl_frame = ControlFrame::read(frame);
+        if (!ctrl_frame.valid)
+        {
+            LOG_F(WARNING, "[match:%d] control frame of player %d too short (%d bytes, dropped)", id, frame.sender, frame.size());
+            return;
+        }
+
+        // the control history drops the ones already received
+        player->rememberControl(ctrl_frame.control, ctrl_frame.reception_server_tick);
+        for (int i = 0; i < ctrl_frame.n_redundant; i++)
+            player->rememberControl(ctrl_frame.redundant[i]);
+        break;
+    }
+    case OP_CONFIG:
+    {
+        sockaddr_in player_addr;
+        if (!network->getAddr(frame.sender, &player_addr))
+        {
+            LOG_F(ERROR, "[match:%d] unknown player %d asking for world (ignored)", id, frame.sender);
+            answerJoin(frame.sender, false);
+            return;
+        }
+
+        // the answer was lost, send it again
+        if (world.getPlayerById(frame.sender))
+        {
+            new_connections.push_back(frame.sender);
+            return;
+        }
+
+        // make sure the name is not too long and
+        // that the string is null terminated
+        if (frame.size() > NAME_SIZE)
+        {
+            NetworkFrame answer;
+            answer.opcode() = OP_WRONG_CONFIG;
+            network->sendTo(frame.sender, answer);
+            answerJoin(frame.sender, false);
+            return;
+        }
+
+        char player_name[NAME_SIZE + 1];
+        memcpy(player_name, frame.content(), frame.size());
+        player_name[frame.size()] = '\0';
+
+        Player *player = world.createPlayer(frame.sender, player_addr, player_name);
+        if (!player)
+        {
+            NetworkFrame answer;
+            answer.opcode() = OP_WRONG_CONFIG;
+            network->sendTo(frame.sender, answer);
+            answerJoin(frame.sender, false);
+            return;
+        }
+
+        LOG_F(INFO, "[match:%d] created new player %s with ID %d", id, player->name.c_str(), player->id);
+        new_connections.push_back(player->id);
+        answerJoin(player->id, true);
+        break;
+    }
+    case OP_CLIENT_READY:
+    {
+        Player *player = world.getPlayerById(frame.sender);
+        if (!player)
+        {
+            LOG_F(ERROR, "[match:%d] unknown player %d is ready (ignored)", id, frame.sender);
+            return;
+        }
+        player->ready = true;
+        break;
+    }
+    default:
+        LOG_F(WARNING, "[match:%d] got unexpected frame: opcode:%hu size:%d (dropped)", id, frame.opcode(), frame.size());
+    }
+}
+
+void Match::sendSnapshots(tick_t client_tick)
+{
+    // produce snapshot for current tick
+    Snapshot snapshot;
+    {
+        ScopedTimer timer(profiler, MATCH_PHASE_SNAPSHOT);
+        snapshot = world.makeSnapshot(client_tick);
+        world.remember(snapshot);
+    }
+
+    if (new_connections.size() > 0)
+    {
+        WorldConfig config;
+        config.client_rate = CLIENT_RATE;
+        config.server_rate = SERVER_RATE;
+        config.ack_size = ACK_SIZE;
+        config.initial_snapshot = &snapshot;
+
+        for (ID player_id : new_connections)
+        {
+            Player *player = world.getPlayerById(player_id);
+            if (!player)
+            {
+                LOG_F(ERROR, "[match:%d] player %d disconnected before I could send world config :(", id, player_id);
+                continue;
+            }
+
+            NetworkFrame frame(config.size());
+            config.write(frame, player, map->getTilemap());
+            network->sendTo(player_id, frame);
+
+            LOG_F(INFO, "[match:%d] sent %d bytes to player %d, initial tick %d", id, frame.size(), player_id, config.initial_snapshot->tick);
+        }
+        new_connections.clear();
+    }
+
+    for (Player *player : world.getPlayers())
+    {
+        if (player->ready && network->isAlive(player->id))
+        {
+            NetworkFrame frame(snapshot.size());
+            {
+                ScopedTimer timer(profiler, MATCH_PHASE_ENCODE, player->id);
+                snapshot.write(frame, player, map->getTilemap());
+            }
+            ScopedTimer timer(profiler, MATCH_PHASE_SEND, player->id);
+            network->sendTo(player->id, frame);
+        }
+    }
+}
+
+void Match::run()
+{
+    loguru::set_thread_name(("match " + std::to_string(id)).c_str());
+    Trace::setThreadName(("match " + std::to_string(id)).c_str());
+
+    // initial snapshot
+    Snapshot snapshot = world.makeSnapshot(0);
+    world.remember(snapshot);
+
+    TickScheduler scheduler(CLIENT_PERIOD, MAX_CATCH_UP_TICKS);
+    tick_t last_server_tick = serverTickOf(scheduler.lastTick());
+    unsigned long long last_dropped = 0;
+
+    std::queue<NetworkFrame> frames;
+    std::vector<ID> lost;
+
+    while (running)
+    {
+        tick_t first_tick;
+        int n_ticks = scheduler.wait(&first_tick);
+        Time::publishFrameTime();
+
+        auto start = std::chrono::steady_clock::now();
+
+        // take everything the network thread routed to us
+        {
+            ScopedTimer timer(profiler, MATCH_PHASE_INBOX);
+            {
+                std::lock_guard<std::mutex> lock(inbox_mutex);
+                std::swap(frames, inbox);
+                std::swap(lost, lost_peers);
+            }
+
+            while (!frames.empty())
+            {
+                handleFrame(frames.front());
+                frames.pop();
+            }
+
+            // after the frames, a peer lost right after asking for a
+            // config doesn't keep its player
+            for (ID player_id : lost)
+                world.dropPlayer(player_id);
+            lost.clear();
+        }
+
+        for (int i = 0; i < n_ticks; i++)
+        {
+            ScopedTimer timer(profiler, MATCH_PHASE_UPDATE, first_tick + i);
+            world.update(first_tick + i);
+        }
+
+        // a single snapshot even if we caught up over several server ticks
+        tick_t client_tick = first_tick + n_ticks - 1;
+        tick_t server_tick = serverTickOf(client_tick);
+        int missed = 0;
+
+        if (server_tick > last_server_tick)
+        {
+            if (server_tick > last_server_tick + 1)
+            {
+                missed = server_tick - last_server_tick - 1;
+                LOG_F(WARNING, "[match:%d] missed server ticks (%d -> %d)", id, last_server_tick, server_tick);
+            }
+
+            sendSnapshots(client_tick);
+            last_server_tick = server_tick;
+        }
+
+        double elapsed = msSince(start);
+        AISchedulerMetrics ai_metrics = world.getAIScheduler()->collectMetrics();
+
+        std::lock_guard<std::mutex> lock(metrics_mutex);
+        metrics.n_players = world.getNPlayers();
+        metrics.n_entities = world.getNEntities();
+        metrics.n_ticks += n_ticks;
+        metrics.n_wakeups++;
+        metrics.mean_tick_ms += elapsed;
+        if (elapsed > metrics.max_tick_ms)
+            metrics.max_tick_ms = elapsed;
+        metrics.missed_server_ticks += missed;
+        metrics.dropped_ticks += (int)(scheduler.droppedTicks() - last_dropped);
+        last_dropped = scheduler.droppedTicks();
+        for (int tier = 0; tier < N_AI_TIERS; tier++)
+            metrics.ai_thinks += ai_metrics.thinks[tier];
+        metrics.ai_postponed += ai_metrics.postponed;
+        metrics.ai_over_budget += ai_metrics.over_budget;
+        if ((int)ai_metrics.max_think_us > metrics.ai_max_think_us)
+            metrics.ai_max_think_us = (int)ai_metrics.max_think_us;
+        InputMetrics input_metrics = world.collectInputMetrics();
+        metrics.input.released += input_metrics.released;
+        metrics.input.underruns += input_metrics.underruns;
+        metrics.input.late += input_metrics.late;
+        metrics.input.depth_sum += input_metrics.depth_sum;
+        if (input_metrics.max_depth > metrics.input.max_depth)
+            metrics.input.max_depth = input_metrics.max_depth;
+        metrics.input.resims += input_metrics.resims;
+        metrics.input.resim_ticks += input_metrics.resim_ticks;
+        metrics.input.resim_dropped += input_metrics.resim_dropped;
+        jitter.record(scheduler.lastLateness());
+    }
+}
+
+//
+//
+//
+// class MATCHMANAGER
+//
+//
+//
+
+MatchManager::MatchManager(UDPServer *network) : network(network) {}
+
+MatchManager::~MatchManager()
+{
+    stop();
+}
+
+void MatchManager::create(int n, Map *map, int first_cpu)
+{
+    for (int i = 0; i < n; i++)
+    {
+        int cpu = first_cpu < 0 ? -1 : first_cpu + i;
+        matches.push_back(std::make_unique<Match>((int)matches.size(), map, network, cpu));
+    }
+}
+
+void MatchManager::start()
+{
+    for (auto &match : matches)
+        match->start();
+}
+
+void MatchManager::stop()
+{
+    for (auto &match : matches)
+        match->stop();
+}
+
+Match *MatchManager::leastLoaded()
+{
+    Match *best = nullptr;
+    int best_count = 0;
+
+    // pending peers count, or a burst of joins would all go to one match
+    for (auto &match : matches)
+    {
+        int count = 0;
+        for (auto &peer : peer_match)
+            if (peer.second == match.get())
+                count++;
+        for (auto &peer : pending_peers)
+            if (peer.second == match.get())
+                count++;
+
+        if (!best || count < best_count)
+        {
+            best = match.get();
+            best_count = count;
+        }
+    }
+
+    return best;
+}
+
+void MatchManager::update()
+{
+    for (auto &match : matches)
+    {
+        match->takeJoins(accepted, rejected);
+
+        for (ID id : accepted)
+        {
+            // dropped while the match was creating its player
+            if (pending_peers.erase(id) == 0)
+                continue;
+
+            peer_match[id] = match.get();
+            LOG_F(INFO, "peer %d joined match %d", id, match->getId());
+        }
+
+        for (ID id : rejected)
+        {
+            pending_peers.erase(id);
+            LOG_F(INFO, "peer %d refused by match %d", id, match->getId());
+        }
+    }
+}
+
+bool MatchManager::route(const NetworkFrame &frame)
+{
+    Match *match = nullptr;
+    auto it = peer_match.find(frame.sender);
+    if (it != peer_match.end())
+        match = it->second;
+    else
+    {
+        auto pending = pending_peers.find(frame.sender);
+        if (pending != pending_peers.end())
+            match = pending->second;
+    }
+
+    if (!match)
+    {
+        // peers join a match when asking for a world config
+        if (frame.opcode() != OP_CONFIG)
+            return false;
+
+        match = leastLoaded();
+        if (!match)
+            return false;
+
+        pending_peers[frame.sender] = match;
+        LOG_F(INFO, "peer %d sent to match %d", frame.sender, match->getId());
+    }
+
+    match->push(frame);
+    return true;
+}
+
+void MatchManager::dropPeer(const ID id)
+{
+    auto it = peer_match.find(id);
+    if (it != peer_match.end())
+    {
+        it->second->dropPeer(id);
+        peer_match.erase(it);
+        return;
+    }
+
+    // a player may have been created meanwhile
+    it = pending_peers.find(id);
+    if (it != pending_peers.end())
+    {
+        it->second->dropPeer(id);
+        pending_peers.erase(it);
+    }
+}
+
+std::vector<MatchMetrics> MatchManager::collectMetrics()
+{
+    std::vector<MatchMetrics> res;
+    for (auto &match : matches)
+        res.push_back(match->collectMetrics());
+    return res;
+}
@@ -0,0 +1,79 @@
+#include "engine/pathfinder.h"
+
+#include "engine/player.h"
+#include "engine/tilemap.h"
+
+Pathfinder::Pathfinder(const TilemapDesc *map) : map(map) {}
+
+void Pathfinder::update(const std::vector<Player *> &players)
+{
+    for (int i = 0; i < (int)targets.size();)
+    {
+        Player *player = nullptr;
+        for (Player *p : players)
+            if (p->id == targets[i].id)
+            {
+                player = p;
+                break;
+            }
+
+        if (!player)
+        {
+            if (targets[i].field.get() == active)
+                active = nullptr;
+            targets[i] = std::move(targets.back());
+            targets.pop_back();
+            continue;
+        }
+
+        if (player->alive)
+            targets[i].field->retarget(map->xyOfWorldPos(player->middle()));
+        i++;
+    }
+
+    for (Player *player : players)
+        if (!getField(player->id))
+        {
+            targets.push_back({player->id, std::make_unique<FlowField>(map->collisions)});
+            if (player->alive)
+                targets.back().field->retarget(map->xyOfWorldPos(player->middle()));
+        }
+
+    // targets that moved a few tiles get their field repaired instead of a
+    // search, each repair costs ~(2 * FLOW_REPAIR_RADIUS + 1)^2 tiles
+    int budget = PATHFINDING_BUDGET;
+    for (Target &target : targets)
+        if (budget > 0 && target.field->canRepair())
+            budget -= target.field->repair();
+
+    while (budget > 0)
+    {
+        if (!active)
+        {
+            int n = (int)targets.size();
+            for (int k = 0; k < n && !active; k++)
+            {
+                FlowField *field = targets[(next_target + k) % n].field.get();
+                if (field->needsSearch())
+                {
+                    active = field;
+                    next_target = (next_target + k + 1) % n;
+                }
+            }
+            if (!active)
+                break;
+        }
+
+        budget -= active->step(budget, queue);
+        if (!active->isSearching())
+            active = nullptr;
+    }
+}
+
+const FlowField *Pathfinder::getField(const ID id) const
+{
+    for (const Target &target : targets)
+        if (target.id == id)
+            return target.field.get();
+    return nullptr;
+}
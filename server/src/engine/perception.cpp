@@ -0,0 +1,118 @@
+#include "engine/perception.h"
+
+#include <cfloat>
+#include <cmath>
+
+#include "engine/collision.h"
+#include "engine/game_config.h"
+#include "engine/player.h"
+#include "network/network.h"
+#include "engine/tilemap.h"
+
+Perception::Perception(const TilemapDesc *map) : map(map)
+{
+    players.reserve(MAX_PEERS);
+    player_x.reserve(MAX_PEERS);
+    player_y.reserve(MAX_PEERS);
+}
+
+void Perception::update(const std::vector<Player *> &players)
+{
+    this->players.clear();
+    player_x.clear();
+    player_y.clear();
+    for (const Player *player : players)
+    {
+        if (!player->alive)
+            continue;
+
+        Vec2f pos = player->middle();
+        this->players.push_back(player);
+        player_x.push_back(pos.x);
+        player_y.push_back(pos.y);
+    }
+}
+
+void Perception::perceive(const Entity *const *entities, const bool *needs_sight, int n, Percept *percepts)
+{
+    if (n <= 0)
+        return;
+
+    const float range2 = PERCEPTION_RANGE * PERCEPTION_RANGE;
+
+    rays.clear();
+    candidates.clear();
+    candidate_dist2.clear();
+    candidate_start.resize(n + 1);
+
+    const int n_players = (int)players.size();
+    const float *px = player_x.data();
+    const float *py = player_y.data();
+
+    // closest player of each entity, and one line of sight per candidate
+    for (int i = 0; i < n; i++)
+    {
+        const Entity *entity = entities[i];
+        Vec2f pos = entity->middle();
+        candidate_start[i] = (int)candidates.size();
+
+        Percept &percept = percepts[i];
+        percept = Percept();
+        percept.valid = true;
+        percept.target_dist2 = FLT_MAX;
+
+        int closest = -1;
+        for (int k = 0; k < n_players; k++)
+        {
+            float dx = px[k] - pos.x;
+            float dy = py[k] - pos.y;
+            float d2 = dx * dx + dy * dy;
+            if (d2 < percept.target_dist2)
+            {
+                percept.target_dist2 = d2;
+                closest = k;
+            }
+
+            if (needs_sight[i] && d2 <= range2)
+            {
+                float dist = sqrtf(d2);
+                candidates.push_back(k);
+                candidate_dist2.push_back(d2);
+                rays.push(pos, dist > 0 ? Vec2f(dx, dy) / dist : Vec2f(1, 0), dist);
+            }
+        }
+
+        if (closest >= 0)
+            percept.target = players[closest];
+    }
+    candidate_start[n] = (int)candidates.size();
+
+    if (rays.size() > 0)
+    {
+        ray_dist.resize(rays.size());
+        computeDistances(rays, map, ray_dist.data());
+        sight.resize(rays.size());
+        for (int k = 0; k < rays.size(); k++)
+            sight[k] = ray_dist[k] >= rays.range[k];
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        Percept &percept = percepts[i];
+
+        float visible_dist2 = FLT_MAX;
+        for (int k = candidate_start[i]; k < candidate_start[i + 1]; k++)
+        {
+            if (!sight[k])
+                continue;
+
+            if (candidate_dist2[k] < visible_dist2)
+            {
+                percept.visible = players[candidates[k]];
+                visible_dist2 = candidate_dist2[k];
+            }
+        }
+        percept.visible_dist2 = visible_dist2;
+        percept.target_in_sight = percept.target && percept.visible == percept.target;
+    }
+}
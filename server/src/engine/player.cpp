@@ -1,17 +1,63 @@
 #include "engine/player.h"
 
-Player::Player(ID id, sockaddr_in addr, std::string name, float max_health) : Entity(id, PLAYER, name, max_health, new PlayerController()), addr(addr) {}
+#include "common/trace.h"
 
-const std::vector<Control *> Player::update(const tick_t current_tick, const TilemapDesc *map)
+Player::Player() : Entity(-1, PLAYER, "__player__", 100, nullptr), addr()
 {
-    std::vector<Control *> ctrls = Entity::update(current_tick, map);
+    controller = &player_controller;
+    owns_controller = false;
+}
+
+Player::Player(ID id, sockaddr_in addr, std::string name, float max_health) : Entity(id, PLAYER, name, max_health, nullptr), addr(addr)
+{
+    controller = &player_controller;
+    owns_controller = false;
+}
+
+void Player::reset(ID id, sockaddr_in addr, std::string name, float max_health)
+{
+    Entity::reset(id, name, max_health);
+
+    this->addr = addr;
+    client_tick = 0;
+    ready = false;
+    pos_history.clear();
+    rewind_from = -1;
+    resim_metrics = {};
+}
+
+void Player::update(const tick_t current_tick, const TilemapDesc *map, ControlList &ctrls)
+{
+    // moved by something else than its controls (spawn, respawn...), the
+    // past doesn't lead here anymore
+    tick_t last_played = pos_history.findPrevPresent(player_controller.getPlayoutTick());
+    if (last_played >= 0 && *pos_history.getById(last_played) != pos)
+    {
+        pos_history.clear();
+        rewind_from = -1;
+    }
+
+    ctrls.clear();
+    player_controller.getControls(current_tick, ctrls);
+
+    // a sweep per control (not one for the whole update like other entities)
+    // as the client predicts them and as resimulate plays them again
+    for (Control *ctrl : ctrls)
+    {
+        last_pos = pos;
+        applyControl(ctrl);
+        doMapCollisions(map);
+        pos_history.write(ctrl->tick, pos);
+    }
+
+    tick_t played = player_controller.getPlayoutTick();
+    if (played >= 0)
+        pos_history.write(played, pos);
 
     tick_t max_tick = client_tick;
     for (Control *ctrl : ctrls)
         max_tick = max(max_tick, ctrl->tick);
     client_tick = max_tick;
-
-    return ctrls;
 }
 
 void Player::applyControl(const Control* control)
@@ -19,7 +65,68 @@ void Player::applyControl(const Control* control)
     Entity::applyControl(control);
 }
 
-void Player::rememberControl(Control &ctrl)
+void Player::rememberControl(Control &ctrl, tick_t arrival_tick)
+{
+    if (arrival_tick >= 0)
+        player_controller.measureArrival(ctrl.tick, arrival_tick);
+    if (!controller->registerControl(ctrl))
+        return;
+
+    // its tick was played without it
+    if (ctrl.tick <= player_controller.getPlayoutTick() && (rewind_from < 0 || ctrl.tick < rewind_from))
+        rewind_from = ctrl.tick;
+}
+
+int Player::resimulate(const TilemapDesc *map, int budget)
+{
+    if (rewind_from < 0)
+        return 0;
+
+    // state before the late tick, all the controls since must still be there
+    tick_t base = pos_history.findPrevPresent(rewind_from - 1);
+    if (base < 0 || base + 1 < player_controller.getOldestTick())
+    {
+        resim_metrics.resim_dropped++;
+        rewind_from = -1;
+        return 0;
+    }
+
+    tick_t last = player_controller.getPlayoutTick();
+    int n_ticks = last - base;
+    if (n_ticks > budget)
+        // next update, if still in the history
+        return 0;
+
+    TraceZone zone("resimulate", id);
+    Vec2f p = *pos_history.getById(base);
+    for (tick_t tick = base + 1; tick <= last; tick++)
+    {
+        const Control *ctrl = player_controller.getControl(tick);
+        if (ctrl)
+        {
+            last_pos = p;
+            pos = p;
+            applyMovement(ctrl);
+            doMapCollisions(map);
+            p = pos;
+        }
+        pos_history.write(tick, p);
+    }
+    last_pos = pos;
+    pos = p;
+
+    rewind_from = -1;
+    resim_metrics.resims++;
+    resim_metrics.resim_ticks += n_ticks;
+    return n_ticks;
+}
+
+InputMetrics Player::collectInputMetrics()
 {
-    controller->registerControl(ctrl);
+    InputMetrics res = player_controller.collectMetrics();
+    res.resims = resim_metrics.resims;
+    res.resim_ticks = resim_metrics.resim_ticks;
+    res.resim_dropped = resim_metrics.resim_dropped;
+    resim_metrics = {};
+    return res;
 }
\ No newline at end of file
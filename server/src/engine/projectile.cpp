@@ -0,0 +1,188 @@
+#include "engine/projectile.h"
+
+#include <algorithm>
+#include <cmath>
+#include "loguru/loguru.hpp"
+
+#include "engine/collision.h"
+#include "engine/entity.h"
+
+const int ProjectileEvent::write(NetworkFrame &frame) const
+{
+    int size = frame.size();
+
+    frame.append(&type, sizeof(type));
+    frame.append(&id, sizeof(id));
+
+    if (type == PROJECTILE_SPAWN)
+        frame.append(&owner, sizeof(owner));
+    else
+        frame.append(&target, sizeof(target));
+
+    frame.append(&x, sizeof(x));
+    frame.append(&y, sizeof(y));
+
+    if (type == PROJECTILE_SPAWN)
+    {
+        frame.append(&angle, sizeof(angle));
+        frame.append(&speed, sizeof(speed));
+    }
+
+    return frame.size() - size;
+}
+
+const int ProjectileEvent::size() const
+{
+    int size = 0;
+    size += sizeof(ProjectileEventType);
+    size += sizeof(uint16_t);
+    size += sizeof(ID);
+    size += sizeof(float);
+    size += sizeof(float);
+    if (type == PROJECTILE_SPAWN)
+    {
+        size += sizeof(float);
+        size += sizeof(float);
+    }
+    return size;
+}
+
+Projectiles::Projectiles()
+{
+    rays.reserve(MAX_PROJECTILES);
+    owner_ids.reserve(MAX_PROJECTILES);
+    owner_circles.reserve(MAX_PROJECTILES);
+    hit_dist.reserve(MAX_PROJECTILES);
+    hit_index.reserve(MAX_PROJECTILES);
+    wall_dist.reserve(MAX_PROJECTILES);
+}
+
+bool Projectiles::spawn(const Bullet &bullet, int bullet_speed, std::vector<ProjectileEvent> &events)
+{
+    if (count >= MAX_PROJECTILES)
+    {
+        LOG_F(WARNING, "too many projectiles in flight, bullet of %d dropped", bullet.owner);
+        return false;
+    }
+
+    int i = count++;
+    id[i] = next_id++;
+    owner[i] = bullet.owner;
+    x[i] = bullet.pos.x;
+    y[i] = bullet.pos.y;
+    angle[i] = bullet.angle;
+    dir_x[i] = bullet.dir.x;
+    dir_y[i] = bullet.dir.y;
+    speed[i] = bullet_speed * CLIENT_PERIOD;
+    damage[i] = bullet.damage;
+    remaining[i] = (float)bullet.range;
+
+    ProjectileEvent event;
+    event.type = PROJECTILE_SPAWN;
+    event.id = id[i];
+    event.owner = owner[i];
+    event.target = -1;
+    event.x = x[i];
+    event.y = y[i];
+    event.angle = angle[i];
+    event.speed = (float)bullet_speed;
+    events.push_back(event);
+
+    return true;
+}
+
+void Projectiles::despawn(int i, ID target, float hit_x, float hit_y, std::vector<ProjectileEvent> &events)
+{
+    ProjectileEvent event;
+    event.type = PROJECTILE_IMPACT;
+    event.id = id[i];
+    event.owner = owner[i];
+    event.target = target;
+    event.x = hit_x;
+    event.y = hit_y;
+    event.angle = 0;
+    event.speed = 0;
+    events.push_back(event);
+
+    // move last projectile into the hole
+    int last = --count;
+    id[i] = id[last];
+    owner[i] = owner[last];
+    x[i] = x[last];
+    y[i] = y[last];
+    angle[i] = angle[last];
+    dir_x[i] = dir_x[last];
+    dir_y[i] = dir_y[last];
+    speed[i] = speed[last];
+    damage[i] = damage[last];
+    remaining[i] = remaining[last];
+}
+
+void Projectiles::update(const std::vector<Entity *> &entities, const TilemapDesc *map, std::vector<ProjectileEvent> &events)
+{
+    if (count == 0)
+        return;
+
+    // a shooter running after its bullet (or stepping into it) must not be
+    // hit, the circle of the owner is skipped like for hitscan
+    owner_ids.assign(owner, owner + count);
+    std::sort(owner_ids.begin(), owner_ids.end());
+    owner_ids.erase(std::unique(owner_ids.begin(), owner_ids.end()), owner_ids.end());
+    owner_circles.assign(owner_ids.size(), -1);
+
+    circles.clear();
+    targets.clear();
+    for (Entity *entity : entities)
+        if (entity->alive)
+        {
+            auto it = std::lower_bound(owner_ids.begin(), owner_ids.end(), entity->id);
+            if (it != owner_ids.end() && *it == entity->id)
+                owner_circles[it - owner_ids.begin()] = circles.size();
+
+            circles.push(entity->middle(), entity->radius);
+            targets.push_back(entity);
+        }
+
+    rays.clear();
+    for (int i = 0; i < count; i++)
+    {
+        float step = speed[i] < remaining[i] ? speed[i] : remaining[i];
+        int skip = owner_circles[std::lower_bound(owner_ids.begin(), owner_ids.end(), owner[i]) - owner_ids.begin()];
+        rays.push(Vec2f(x[i], y[i]), Vec2f(dir_x[i], dir_y[i]), step, skip);
+    }
+
+    hit_dist.resize(count);
+    hit_index.resize(count);
+    computeClosestHits(rays, circles, hit_dist.data(), hit_index.data());
+
+    wall_dist.resize(count);
+    computeDistances(rays, map, wall_dist.data());
+
+    // go backwards so that the projectile moved into a hole by despawn has
+    // already been processed
+    for (int i = count - 1; i >= 0; i--)
+    {
+        float step = rays.range[i];
+
+        if (hit_index[i] >= 0 && hit_dist[i] <= wall_dist[i])
+        {
+            Entity *target = targets[hit_index[i]];
+            target->hurt(damage[i]);
+            despawn(i, target->id, x[i] + dir_x[i] * hit_dist[i], y[i] + dir_y[i] * hit_dist[i], events);
+            continue;
+        }
+
+        if (wall_dist[i] < step)
+        {
+            despawn(i, -1, x[i] + dir_x[i] * wall_dist[i], y[i] + dir_y[i] * wall_dist[i], events);
+            continue;
+        }
+
+        x[i] += dir_x[i] * step;
+        y[i] += dir_y[i] * step;
+        remaining[i] -= step;
+
+        if (remaining[i] <= 0)
+            despawn(i, -1, x[i], y[i], events);
+    }
+}
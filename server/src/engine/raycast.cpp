@@ -0,0 +1,262 @@
+#include "engine/raycast.h"
+
+#include <cfloat>
+#include <cmath>
+
+#if defined(__AVX2__)
+#define RAYCAST_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RAYCAST_SSE2 1
+#include <emmintrin.h>
+#endif
+
+void CircleBatch::clear()
+{
+    x.clear();
+    y.clear();
+    radius.clear();
+}
+
+void CircleBatch::reserve(const int n)
+{
+    x.reserve(n);
+    y.reserve(n);
+    radius.reserve(n);
+}
+
+void CircleBatch::push(const Vec2f center, const float r)
+{
+    x.push_back(center.x);
+    y.push_back(center.y);
+    radius.push_back(r);
+}
+
+void RayBatch::clear()
+{
+    x.clear();
+    y.clear();
+    dir_x.clear();
+    dir_y.clear();
+    range.clear();
+    skip.clear();
+}
+
+void RayBatch::reserve(const int n)
+{
+    x.reserve(n);
+    y.reserve(n);
+    dir_x.reserve(n);
+    dir_y.reserve(n);
+    range.reserve(n);
+    skip.reserve(n);
+}
+
+void RayBatch::push(const Vec2f origin, const Vec2f dir, const float r, const int s)
+{
+    x.push_back(origin.x);
+    y.push_back(origin.y);
+    dir_x.push_back(dir.x);
+    dir_y.push_back(dir.y);
+    range.push_back(r);
+    skip.push_back(s);
+}
+
+// Same maths as computeDistance(ray, sphere) in collision.cpp, but since the
+// direction has unit length, the squared distance from the center to the ray
+// is |L|^2 - t^2 and we never need the projected point.
+// Circles [from, n) are tested, `best_dist`/`best_index` are updated only if a
+// strictly closer hit is found so that lower indices win ties.
+static void closestHitScalar(float ox, float oy, float dx, float dy, float range, int skip,
+                             const CircleBatch &circles, int from, float *best_dist, int *best_index)
+{
+    const float *cx = circles.x.data();
+    const float *cy = circles.y.data();
+    const float *cr = circles.radius.data();
+    const int n = circles.size();
+
+    for (int j = from; j < n; j++)
+    {
+        if (j == skip)
+            continue;
+
+        float lx = cx[j] - ox;
+        float ly = cy[j] - oy;
+        float t = lx * dx + ly * dy;
+        float y2 = lx * lx + ly * ly - t * t;
+        float r2 = cr[j] * cr[j];
+
+        if (y2 > r2)
+            continue;
+
+        float d = t - sqrtf(r2 - y2);
+        if (d > 0 && d <= range && d < *best_dist)
+        {
+            *best_dist = d;
+            *best_index = j;
+        }
+    }
+}
+
+// merge per-lane results, ties go to the lowest circle index
+static void reduceLanes(const float *dist, const int *index, int n_lanes, float *best_dist, int *best_index)
+{
+    for (int k = 0; k < n_lanes; k++)
+    {
+        if (index[k] < 0)
+            continue;
+        if (dist[k] < *best_dist || (dist[k] == *best_dist && index[k] < *best_index))
+        {
+            *best_dist = dist[k];
+            *best_index = index[k];
+        }
+    }
+}
+
+#if RAYCAST_AVX2
+
+static int closestHitSIMD(float ox, float oy, float dx, float dy, float range, int skip,
+                          const CircleBatch &circles, float *best_dist, int *best_index)
+{
+    const int n = circles.size();
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 v_ox = _mm256_set1_ps(ox);
+    const __m256 v_oy = _mm256_set1_ps(oy);
+    const __m256 v_dx = _mm256_set1_ps(dx);
+    const __m256 v_dy = _mm256_set1_ps(dy);
+    const __m256 v_range = _mm256_set1_ps(range);
+    const __m256i v_skip = _mm256_set1_epi32(skip);
+    const __m256i v_step = _mm256_set1_epi32(8);
+
+    __m256 v_best = _mm256_set1_ps(FLT_MAX);
+    __m256i v_best_i = _mm256_set1_epi32(-1);
+    __m256i v_i = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    int j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256 lx = _mm256_sub_ps(_mm256_loadu_ps(&circles.x[j]), v_ox);
+        __m256 ly = _mm256_sub_ps(_mm256_loadu_ps(&circles.y[j]), v_oy);
+        __m256 r = _mm256_loadu_ps(&circles.radius[j]);
+
+        __m256 t = _mm256_add_ps(_mm256_mul_ps(lx, v_dx), _mm256_mul_ps(ly, v_dy));
+        __m256 y2 = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(lx, lx), _mm256_mul_ps(ly, ly)), _mm256_mul_ps(t, t));
+        __m256 x2 = _mm256_sub_ps(_mm256_mul_ps(r, r), y2);
+
+        __m256 d = _mm256_sub_ps(t, _mm256_sqrt_ps(_mm256_max_ps(x2, zero)));
+
+        __m256 ok = _mm256_cmp_ps(x2, zero, _CMP_GE_OQ);
+        ok = _mm256_and_ps(ok, _mm256_cmp_ps(d, zero, _CMP_GT_OQ));
+        ok = _mm256_and_ps(ok, _mm256_cmp_ps(d, v_range, _CMP_LE_OQ));
+        ok = _mm256_and_ps(ok, _mm256_cmp_ps(d, v_best, _CMP_LT_OQ));
+        ok = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v_i, v_skip)), ok);
+
+        v_best = _mm256_blendv_ps(v_best, d, ok);
+        v_best_i = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(v_best_i), _mm256_castsi256_ps(v_i), ok));
+        v_i = _mm256_add_epi32(v_i, v_step);
+    }
+
+    float dist[8];
+    int index[8];
+    _mm256_storeu_ps(dist, v_best);
+    _mm256_storeu_si256((__m256i *)index, v_best_i);
+    reduceLanes(dist, index, 8, best_dist, best_index);
+
+    return j;
+}
+
+#elif RAYCAST_SSE2
+
+static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static int closestHitSIMD(float ox, float oy, float dx, float dy, float range, int skip,
+                          const CircleBatch &circles, float *best_dist, int *best_index)
+{
+    const int n = circles.size();
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 v_ox = _mm_set1_ps(ox);
+    const __m128 v_oy = _mm_set1_ps(oy);
+    const __m128 v_dx = _mm_set1_ps(dx);
+    const __m128 v_dy = _mm_set1_ps(dy);
+    const __m128 v_range = _mm_set1_ps(range);
+    const __m128i v_skip = _mm_set1_epi32(skip);
+    const __m128i v_step = _mm_set1_epi32(4);
+
+    __m128 v_best = _mm_set1_ps(FLT_MAX);
+    __m128 v_best_i = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    __m128i v_i = _mm_setr_epi32(0, 1, 2, 3);
+
+    int j = 0;
+    for (; j + 4 <= n; j += 4)
+    {
+        __m128 lx = _mm_sub_ps(_mm_loadu_ps(&circles.x[j]), v_ox);
+        __m128 ly = _mm_sub_ps(_mm_loadu_ps(&circles.y[j]), v_oy);
+        __m128 r = _mm_loadu_ps(&circles.radius[j]);
+
+        __m128 t = _mm_add_ps(_mm_mul_ps(lx, v_dx), _mm_mul_ps(ly, v_dy));
+        __m128 y2 = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)), _mm_mul_ps(t, t));
+        __m128 x2 = _mm_sub_ps(_mm_mul_ps(r, r), y2);
+
+        __m128 d = _mm_sub_ps(t, _mm_sqrt_ps(_mm_max_ps(x2, zero)));
+
+        __m128 ok = _mm_cmpge_ps(x2, zero);
+        ok = _mm_and_ps(ok, _mm_cmpgt_ps(d, zero));
+        ok = _mm_and_ps(ok, _mm_cmple_ps(d, v_range));
+        ok = _mm_and_ps(ok, _mm_cmplt_ps(d, v_best));
+        ok = _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v_i, v_skip)), ok);
+
+        v_best = select(ok, d, v_best);
+        v_best_i = select(ok, _mm_castsi128_ps(v_i), v_best_i);
+        v_i = _mm_add_epi32(v_i, v_step);
+    }
+
+    float dist[4];
+    int index[4];
+    _mm_storeu_ps(dist, v_best);
+    _mm_storeu_si128((__m128i *)index, _mm_castps_si128(v_best_i));
+    reduceLanes(dist, index, 4, best_dist, best_index);
+
+    return j;
+}
+
+#endif
+
+void computeClosestHitsScalar(const RayBatch &rays, const CircleBatch &circles, float *out_dist, int *out_index)
+{
+    for (int i = 0; i < rays.size(); i++)
+    {
+        float best_dist = FLT_MAX;
+        int best_index = -1;
+
+        closestHitScalar(rays.x[i], rays.y[i], rays.dir_x[i], rays.dir_y[i], rays.range[i], rays.skip[i],
+                         circles, 0, &best_dist, &best_index);
+
+        out_dist[i] = best_index < 0 ? -1 : best_dist;
+        out_index[i] = best_index;
+    }
+}
+
+void computeClosestHits(const RayBatch &rays, const CircleBatch &circles, float *out_dist, int *out_index)
+{
+#if RAYCAST_AVX2 || RAYCAST_SSE2
+    for (int i = 0; i < rays.size(); i++)
+    {
+        float best_dist = FLT_MAX;
+        int best_index = -1;
+
+        // SIMD over circles, then finish the remaining ones one by one
+        int done = closestHitSIMD(rays.x[i], rays.y[i], rays.dir_x[i], rays.dir_y[i], rays.range[i], rays.skip[i],
+                                  circles, &best_dist, &best_index);
+        closestHitScalar(rays.x[i], rays.y[i], rays.dir_x[i], rays.dir_y[i], rays.range[i], rays.skip[i],
+                         circles, done, &best_dist, &best_index);
+
+        out_dist[i] = best_index < 0 ? -1 : best_dist;
+        out_index[i] = best_index;
+    }
+#else
+    computeClosestHitsScalar(rays, circles, out_dist, out_index);
+#endif
+}
@@ -0,0 +1,185 @@
+#include "engine/spawner.h"
+
+#include <cmath>
+#include "loguru/loguru.hpp"
+
+#include "engine/ai.h"
+#include "engine/game_config.h"
+#include "engine/tilemap.h"
+#include "engine/world.h"
+
+#define M_PI 3.14159265359f
+#define SPAWN_TRIES 8 // attempts to find a free position before falling back on the object position
+#define NPC_RADIUS 9
+
+static tick_t ticksOfSeconds(float seconds)
+{
+    return (tick_t)(seconds / CLIENT_PERIOD);
+}
+
+EntitySpawner::EntitySpawner(World *world, Map *map, std::shared_ptr<AI> ai) : world(world), map(map), ai(ai)
+{
+    Random random;
+
+    for (int g = 0; g < map->enemy_groups.size(); g++)
+    {
+        const EnemyGroup &group = map->enemy_groups[g];
+        random.setSeed(group.id);
+
+        GroupState state;
+        state.first_slot = (int)slots.size();
+        state.next_slot = state.first_slot;
+        state.next_wave_tick = 0;
+
+        for (int e = 0; e < group.elts.size(); e++)
+        {
+            const Enemy &enemy = group.elts[e];
+            for (int i = 0; i < enemy.count; i++)
+            {
+                SpawnSlot slot;
+                slot.group = g;
+                slot.enemy = e;
+                slot.pos = i == 0 ? enemy.pos : findSpawnPosition(enemy, random);
+                slot.state = SLOT_WAITING_WAVE;
+                slot.respawn_tick = 0;
+                slot.npc = nullptr;
+                slots.push_back(slot);
+            }
+        }
+
+        state.end_slot = (int)slots.size();
+        groups.push_back(state);
+    }
+
+    npcs = std::make_unique<Pool<NPC>>((int)slots.size());
+
+    LOG_F(INFO, "spawner ready: %d enemy groups, %d NPC slots", (int)groups.size(), (int)slots.size());
+}
+
+Vec2f EntitySpawner::findSpawnPosition(const Enemy &enemy, Random &random) const
+{
+    const TilemapDesc *tilemap = map->getTilemap();
+    float tile_size = (float)(tilemap->tile_size * tilemap->scale);
+
+    // the tile under the middle of the NPC must be far enough from walls for
+    // the whole box to fit
+    int needed = (int)ceilf(NPC_RADIUS / tile_size) + 1;
+
+    for (int i = 0; i < SPAWN_TRIES; i++)
+    {
+        float angle = (float)random.uniform(0, 2 * M_PI);
+        float dist = enemy.spread * (float)sqrt(random.random());
+        Vec2f pos = enemy.pos + Vec2f(dist * cosf(angle), dist * sinf(angle));
+
+        if (pos.x < 0 || pos.y < 0)
+            continue;
+
+        if (tilemap->getClearance(pos + Vec2f(NPC_RADIUS, NPC_RADIUS)) >= needed)
+            return pos;
+    }
+
+    return enemy.pos;
+}
+
+void EntitySpawner::setAI(const std::string &behavior, std::shared_ptr<AI> ai)
+{
+    for (auto &behavior_ai : behavior_ais)
+        if (behavior_ai.first == behavior)
+        {
+            behavior_ai.second = ai;
+            return;
+        }
+    behavior_ais.push_back({behavior, ai});
+}
+
+std::shared_ptr<AI> EntitySpawner::getAI(const Enemy &enemy) const
+{
+    if (enemy.behavior.empty())
+        return ai;
+
+    for (auto &behavior_ai : behavior_ais)
+        if (behavior_ai.first == enemy.behavior)
+            return behavior_ai.second;
+    return ai;
+}
+
+bool EntitySpawner::owns(const Entity *entity) const
+{
+    return npcs->owns((const NPC *)entity);
+}
+
+bool EntitySpawner::spawn(int i)
+{
+    SpawnSlot &slot = slots[i];
+
+    NPC *npc = npcs->acquire();
+    if (!npc)
+    {
+        LOG_F(ERROR, "spawner: no NPC left for slot %d", i);
+        return false;
+    }
+
+    const Enemy &enemy = map->enemy_groups[slot.group].elts[slot.enemy];
+    npc->reset(-1, enemy.name, slot.pos, getAI(enemy));
+    npc->slot = i;
+
+    slot.npc = npc;
+    slot.state = SLOT_ALIVE;
+    n_alive++;
+
+    world->add(npc);
+    return true;
+}
+
+void EntitySpawner::despawn(int i, tick_t current_tick)
+{
+    SpawnSlot &slot = slots[i];
+    const WaveRules &rules = map->enemy_groups[slot.group].rules;
+
+    world->remove(slot.npc);
+    npcs->release(slot.npc);
+
+    slot.npc = nullptr;
+    n_alive--;
+
+    if (rules.respawn_delay >= 0)
+    {
+        slot.state = SLOT_RESPAWNING;
+        slot.respawn_tick = current_tick + ticksOfSeconds(rules.respawn_delay);
+    }
+    else
+        slot.state = SLOT_DONE;
+}
+
+void EntitySpawner::update(tick_t current_tick)
+{
+    for (int i = 0; i < slots.size(); i++)
+    {
+        SpawnSlot &slot = slots[i];
+
+        if (slot.state == SLOT_ALIVE && !slot.npc->alive)
+            despawn(i, current_tick);
+        else if (slot.state == SLOT_RESPAWNING && current_tick >= slot.respawn_tick)
+            spawn(i);
+    }
+
+    for (int g = 0; g < groups.size(); g++)
+    {
+        GroupState &state = groups[g];
+        if (state.next_slot >= state.end_slot || current_tick < state.next_wave_tick)
+            continue;
+
+        const WaveRules &rules = map->enemy_groups[g].rules;
+        int n = rules.wave_size > 0 ? rules.wave_size : state.end_slot - state.next_slot;
+
+        // a slot that could not spawn waits for the next wave
+        for (int i = 0; i < n && state.next_slot < state.end_slot; i++)
+        {
+            if (!spawn(state.next_slot))
+                break;
+            state.next_slot++;
+        }
+
+        state.next_wave_tick = current_tick + ticksOfSeconds(rules.wave_period);
+    }
+}
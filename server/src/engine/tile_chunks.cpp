@@ -0,0 +1,126 @@
+#include "engine/tile_chunks.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PAGE_TILES (CHUNK_SIZE * CHUNK_SIZE)
+
+TileChunks::TileChunks(const int width, const int height, const TILE tile) : width(width), height(height)
+{
+    chunks_x = (width + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    chunks_y = (height + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    chunks.assign((size_t)chunks_x * chunks_y, Chunk{nullptr, tile, false});
+}
+
+TileChunks::~TileChunks()
+{
+    for (Chunk &chunk : chunks)
+        freePage(chunk);
+}
+
+void TileChunks::freePage(Chunk &chunk)
+{
+    if (chunk.owned)
+        free(chunk.page);
+    chunk.page = nullptr;
+    chunk.owned = false;
+}
+
+void TileChunks::set(const int x, const int y, const TILE tile)
+{
+    Chunk &chunk = chunkOf(x, y);
+    if (!chunk.page)
+    {
+        if (tile == chunk.uniform)
+            return;
+
+        chunk.page = (TILE *)malloc(PAGE_TILES * sizeof(TILE));
+        chunk.owned = true;
+        for (int i = 0; i < PAGE_TILES; i++)
+            chunk.page[i] = chunk.uniform;
+    }
+    chunk.page[((y & (CHUNK_SIZE - 1)) << CHUNK_SHIFT) + (x & (CHUNK_SIZE - 1))] = tile;
+}
+
+void TileChunks::fill(const TILE tile)
+{
+    for (Chunk &chunk : chunks)
+    {
+        freePage(chunk);
+        chunk.uniform = tile;
+    }
+}
+
+void TileChunks::compact()
+{
+    for (int cy = 0; cy < chunks_y; cy++)
+        for (int cx = 0; cx < chunks_x; cx++)
+        {
+            Chunk &chunk = chunks[(size_t)cy * chunks_x + cx];
+            if (!chunk.page)
+                continue;
+
+            // chunks on the right/bottom edges are only partly in the map
+            int w = width - (cx << CHUNK_SHIFT) < CHUNK_SIZE ? width - (cx << CHUNK_SHIFT) : CHUNK_SIZE;
+            int h = height - (cy << CHUNK_SHIFT) < CHUNK_SIZE ? height - (cy << CHUNK_SHIFT) : CHUNK_SIZE;
+
+            TILE first = chunk.page[0];
+            bool uniform = true;
+            for (int y = 0; y < h && uniform; y++)
+                for (int x = 0; x < w; x++)
+                    if (chunk.page[(y << CHUNK_SHIFT) + x] != first)
+                    {
+                        uniform = false;
+                        break;
+                    }
+
+            if (uniform)
+            {
+                freePage(chunk);
+                chunk.uniform = first;
+            }
+        }
+}
+
+int TileChunks::getNPages() const
+{
+    int n = 0;
+    for (const Chunk &chunk : chunks)
+        n += chunk.page != nullptr;
+    return n;
+}
+
+void TileChunks::copyRow(const int x, const int y, const int n, TILE *out) const
+{
+    int i = 0;
+    while (i < n)
+    {
+        // as many tiles as possible from the chunk of (x + i, y)
+        int cx = x + i;
+        int in_chunk = CHUNK_SIZE - (cx & (CHUNK_SIZE - 1));
+        int count = in_chunk < n - i ? in_chunk : n - i;
+
+        const Chunk &chunk = chunkOf(cx, y);
+        if (chunk.page)
+            memcpy(&out[i], &chunk.page[((y & (CHUNK_SIZE - 1)) << CHUNK_SHIFT) + (cx & (CHUNK_SIZE - 1))], count * sizeof(TILE));
+        else
+            for (int j = 0; j < count; j++)
+                out[i + j] = chunk.uniform;
+
+        i += count;
+    }
+}
+
+void TileChunks::setUniform(const int cx, const int cy, const TILE tile)
+{
+    Chunk &chunk = chunks[(size_t)cy * chunks_x + cx];
+    freePage(chunk);
+    chunk.uniform = tile;
+}
+
+void TileChunks::borrowPage(const int cx, const int cy, TILE *page)
+{
+    Chunk &chunk = chunks[(size_t)cy * chunks_x + cx];
+    freePage(chunk);
+    chunk.page = page;
+}
@@ -6,6 +6,7 @@
 
 #include "common/vector.hpp"
 #include "common/utils.h"
+#include "engine/cooked_map.h"
 
 namespace fs = std::filesystem;
 
@@ -60,9 +61,8 @@ int TilemapDesc::indexOfXY(const int x, const int y) const
 
 const TILE TilemapDesc::getTile(const int x, const int y) const
 {
-    int address = indexOfXY(x, y);
-    if (address >= 0 && address < width * height)
-        return tiles[address];
+    if (x >= 0 && x < width && y >= 0 && y < height)
+        return tiles->get(x, y);
     return -1;
 }
 
@@ -73,9 +73,8 @@ const TILE TilemapDesc::getTile(const Vec2i xy) const
 
 void TilemapDesc::setTile(const int x, const int y, const TILE tile)
 {
-    int address = indexOfXY(x, y);
-    if (address >= 0 && address < width * height)
-        tiles[address] = tile;
+    if (x >= 0 && x < width && y >= 0 && y < height)
+        tiles->set(x, y, tile);
 }
 
 void TilemapDesc::setTile(const Vec2i xy, const TILE tile)
@@ -85,7 +84,7 @@ void TilemapDesc::setTile(const Vec2i xy, const TILE tile)
 
 const bool TilemapDesc::getSolid(const int x, const int y) const
 {
-    return collisions->get(indexOfXY(x, y));
+    return collisions->get(x, y);
 }
 
 const bool TilemapDesc::getSolid(const Vec2i xy) const
@@ -93,6 +92,19 @@ const bool TilemapDesc::getSolid(const Vec2i xy) const
     return getSolid(xy.x, xy.y);
 }
 
+const uint8_t TilemapDesc::getClearance(const int x, const int y) const
+{
+    if (x < -1 || x > width || y < -1 || y > height)
+        return 0;
+    return clearance->get(x, y);
+}
+
+const uint8_t TilemapDesc::getClearance(const Vec2f pos) const
+{
+    Vec2i xy = xyOfWorldPos(pos);
+    return getClearance(xy.x, xy.y);
+}
+
 void TilemapDesc::setBorder(const int n, const TILE tile)
 {
     for (int x = 0; x < width; x++)
@@ -114,8 +126,7 @@ void TilemapDesc::setBorder(const int n, const TILE tile)
 
 void TilemapDesc::fill(const TILE tile)
 {
-    for (int i = 0; i < width * height; i++)
-        tiles[i] = tile;
+    tiles->fill(tile);
 }
 
 const framesize_t TilemapDesc::write(NetworkFrame &frame) const
@@ -126,7 +137,14 @@ const framesize_t TilemapDesc::write(NetworkFrame &frame) const
     frame.append(&height, sizeof(height));
     frame.append(&tile_size, sizeof(tile_size));
     frame.append(&scale, sizeof(scale));
-    frame.append(tiles, (framesize_t)(width * height * sizeof(TILE)));
+
+    // flat, row by row, as the clients expect it
+    std::vector<TILE> row(width);
+    for (int y = 0; y < height; y++)
+    {
+        tiles->copyRow(0, y, width, row.data());
+        frame.append(row.data(), width * sizeof(TILE));
+    }
 
     return frame.size() - size;
 }
@@ -155,6 +173,9 @@ bool Map::load(const char *path)
         return false;
     }
 
+    if (fs::path(path).extension() == COOKED_MAP_EXTENSION)
+        return loadCooked(path);
+
     LOG_F(INFO, "loading %s", path);
 
     tinyxml2::XMLDocument doc;
@@ -175,11 +196,8 @@ bool Map::load(const char *path)
 
     LOG_F(INFO, "map grid dimension %d, %d, tile size %d * %hu", tilemap.width, tilemap.height, tilemap.tile_size, tilemap.scale);
 
-    int flatsize = tilemap.width * tilemap.height;
-    tilemap.tiles = (TILE *)malloc(flatsize * sizeof(TILE));
-    for (int i = 0; i < flatsize; i++)
-        tilemap.tiles[i] = 0;
-    tilemap.collisions = new BitArray(flatsize);
+    tilemap.tiles = new TileChunks(tilemap.width, tilemap.height);
+    tilemap.collisions = new CollisionMap(tilemap.width, tilemap.height);
 
     tinyxml2::XMLElement *tileset = map_element->FirstChildElement("tileset");
     const char *tileset_filename = tileset->Attribute("source");
@@ -192,6 +210,13 @@ bool Map::load(const char *path)
     for (tinyxml2::XMLElement *e = map_element->FirstChildElement("layer"); e != nullptr; e = e->NextSiblingElement("layer"))
         loadLayer(e);
 
+    tilemap.tiles->compact();
+    tilemap.collisions->summarize();
+    LOG_F(INFO, "%d of %d chunks are not uniform", tilemap.tiles->getNPages(), tilemap.tiles->getChunksX() * tilemap.tiles->getChunksY());
+
+    tilemap.clearance = new DistanceField();
+    tilemap.clearance->build(*tilemap.collisions);
+
     for (tinyxml2::XMLElement *e = map_element->FirstChildElement("objectgroup"); e != nullptr; e = e->NextSiblingElement("objectgroup"))
     {
         const char *name = e->Attribute("name");
@@ -208,26 +233,51 @@ bool Map::load(const char *path)
 
 void Map::loadEnemies(tinyxml2::XMLElement *layer)
 {
-    Group<Enemy> group;
+    EnemyGroup group;
     group.id = layer->IntAttribute("id");
 
     LOG_F(INFO, "loading enemy group %d", group.id);
 
+    tinyxml2::XMLElement *group_properties = layer->FirstChildElement("properties");
+    if (group_properties)
+        for (tinyxml2::XMLElement *p = group_properties->FirstChildElement("property"); p != nullptr; p = p->NextSiblingElement("property"))
+        {
+            const char *name = p->Attribute("name");
+            if (!name)
+                continue;
+
+            if (strcmp(name, "wave_size") == 0)
+                group.rules.wave_size = p->IntAttribute("value");
+            else if (strcmp(name, "wave_period") == 0)
+                group.rules.wave_period = p->FloatAttribute("value");
+            else if (strcmp(name, "respawn_delay") == 0)
+                group.rules.respawn_delay = p->FloatAttribute("value");
+        }
+
     for (tinyxml2::XMLElement *e = layer->FirstChildElement("object"); e != nullptr; e = e->NextSiblingElement("object"))
     {
         Enemy enemy;
-        enemy.name = e->Attribute("name");
+        enemy.name = e->Attribute("name") ? e->Attribute("name") : "__enemy__";
         enemy.pos.x = e->FloatAttribute("x") * tilemap.scale;
         enemy.pos.y = e->FloatAttribute("y") * tilemap.scale;
 
         tinyxml2::XMLElement *properties = e->FirstChildElement("properties");
-        for (tinyxml2::XMLElement *e = layer->FirstChildElement("object"); e != nullptr; e = e->NextSiblingElement("object"))
-        {
-            const char *name = e->Attribute("name");
-            const char *type = e->Attribute("type");
-            if (strcmp(name, "difficulty") == 0 && strcmp(type, "int") == 0)
-                enemy.difficulty = e->IntAttribute("value");
-        }
+        if (properties)
+            for (tinyxml2::XMLElement *p = properties->FirstChildElement("property"); p != nullptr; p = p->NextSiblingElement("property"))
+            {
+                const char *name = p->Attribute("name");
+                if (!name)
+                    continue;
+
+                if (strcmp(name, "difficulty") == 0)
+                    enemy.difficulty = p->IntAttribute("value");
+                else if (strcmp(name, "count") == 0)
+                    enemy.count = p->IntAttribute("value");
+                else if (strcmp(name, "spread") == 0)
+                    enemy.spread = p->FloatAttribute("value") * tilemap.scale;
+                else if (strcmp(name, "behavior") == 0 && p->Attribute("value"))
+                    enemy.behavior = p->Attribute("value");
+            }
 
         group.elts.push_back(enemy);
     }
@@ -270,10 +320,11 @@ void Map::loadLayer(tinyxml2::XMLElement *layer)
         if (tile_id > 0)
         {
             TILE id = (TILE)tile_id;
-            memcpy(&tilemap.tiles[i], &id, sizeof(id));
+            Vec2i xy = tilemap.xyOfIndex(i);
+            tilemap.tiles->set(xy.x, xy.y, id);
 
             int actual_id = (id << 3) >> 3;
-            tilemap.collisions->set(i, tileset.solid->get(actual_id - 1));
+            tilemap.collisions->set(xy.x, xy.y, tileset.solid->get(actual_id - 1));
         }
 
         if (s_stream.peek() == ',')
@@ -1,9 +1,11 @@
 #include "engine/world.h"
 
+#include <algorithm>
 #include <cstring>
 #include <math.h>
 #include "loguru/loguru.hpp"
 
+#include "common/trace.h"
 #include "engine/tilemap.h"
 
 const int Snapshot::write(NetworkFrame &frame, const Player *player, const TilemapDesc *tilemap) const
@@ -16,12 +18,17 @@ const int Snapshot::write(NetworkFrame &frame, const Player *player, const Tilem
     tick_t client_tick = player == nullptr ? -1 : player->client_tick;
     frame.append(&client_tick, sizeof(client_tick));
 
-    // EntityDesc::write will update size
+    // the controls received so far, so that the client only repeats the
+    // missing ones (ACK_SIZE bytes, little endian like the rest)
+    tick_t control_tick = player == nullptr ? -1 : player->getPlayerController().getLastReceivedTick();
+    uint64_t control_ack = player == nullptr ? 0 : player->getPlayerController().makeAck();
+    frame.append(&control_tick, sizeof(control_tick));
+    frame.append(&control_ack, ACK_SIZE);
 
-    int n_entities = (int)entities.size();
+    // EntityDesc::write will update size
 
-    EntityDesc *player_desc = nullptr;
-    for (EntityDesc desc : entities)
+    const EntityDesc *player_desc = nullptr;
+    for (const EntityDesc &desc : entities)
         if (player && desc.id == player->id)
         {
             desc.write(frame, true);
@@ -36,32 +43,93 @@ const int Snapshot::write(NetworkFrame &frame, const Player *player, const Tilem
         frame.append(&id, sizeof(id));
     }
 
+    // area of interest: only the entities and events close to the player are
+    // sent, and no more than one datagram holds. Scratch buffers are per
+    // match thread.
+    static thread_local std::vector<std::pair<float, int>> candidates; // (squared distance, entity)
+    static thread_local std::vector<const ProjectileEvent *> events;
+    static thread_local RayBatch visibility_rays;
+    static thread_local std::vector<float> visibility_dist;
+
+    const bool has_eye = player_desc != nullptr;
+    const Vec2f eye = has_eye ? Vec2f(player_desc->x + player_desc->radius, player_desc->y + player_desc->radius) : Vec2f(0, 0);
+    const float aoi_radius2 = AOI_RADIUS * AOI_RADIUS;
+
+    // events go last but their room is taken first, at most a quarter of
+    // the datagram (far more than MAX_PROJECTILES events of a tick nearby)
+    int events_size = 0;
+    events.clear();
+    if (projectile_events)
+        for (const ProjectileEvent &event : *projectile_events)
+        {
+            Vec2f delta = Vec2f(event.x, event.y) - eye;
+            if (has_eye && delta * delta > aoi_radius2)
+                continue;
+            if (events_size + event.size() > MAX_SNAPSHOT_SIZE / 4)
+                break;
+            events.push_back(&event);
+            events_size += event.size();
+        }
+
+    const int tail_size = sizeof(int) + sizeof(ID) * (int)despawned_entities.size() + sizeof(int) + events_size;
+    const int max_size = MAX_SNAPSHOT_SIZE - HEADER_SIZE - tail_size;
+
+    candidates.clear();
+    for (int i = 0; i < entities.size(); i++)
+    {
+        const EntityDesc &desc = entities[i];
+        if (player && desc.id == player->id)
+            continue;
+
+        Vec2f delta = Vec2f(desc.x + desc.radius, desc.y + desc.radius) - eye;
+        float dist2 = delta * delta;
+        if (has_eye && dist2 > aoi_radius2)
+            continue;
+        candidates.push_back({dist2, i});
+    }
+
+    // closest first if they may not all fit
+    if ((frame.size() - size) + sizeof(int) + candidates.size() * EntityDesc::size() > max_size)
+        std::sort(candidates.begin(), candidates.end());
+
+    // visibility of every candidate from the player, one ray each, traced
+    // together
+    bool check_visibility = has_eye && tilemap;
+    if (check_visibility)
+    {
+        visibility_rays.clear();
+        for (const std::pair<float, int> &candidate : candidates)
+        {
+            const EntityDesc &desc = entities[candidate.second];
+            Vec2f delta = Vec2f(desc.x + desc.radius, desc.y + desc.radius) - eye;
+            float dist = sqrtf(candidate.first);
+            Vec2f dir = dist > 0 ? delta / dist : Vec2f(1, 0);
+            visibility_rays.push(eye, dir, dist);
+        }
+
+        visibility_dist.resize(candidates.size());
+        computeDistances(visibility_rays, tilemap, visibility_dist.data());
+    }
+
     int n = 0; // number of written entities
-    char *n_addr = &frame.content()[frame.size()];
+    int n_offset = frame.size();
     frame.append(&n, sizeof(n)); // will be updated after the loop
 
     // EntityDesc::write will update size
-    for (EntityDesc desc : entities)
+    for (int c = 0; c < candidates.size(); c++)
     {
-        if (player_desc && tilemap)
-        {
-            // don't send entity if it is not visible by player
-            float player_entity_dist = sqrt((player_desc->x - desc.x) * (player_desc->x - desc.x) + (player_desc->y - desc.y) * (player_desc->y - desc.y));
-            float player_entity_angle = atan2(desc.y - player_desc->y, desc.x - player_desc->x);
-            float ray_dist = computeDistance(Vec2f(player_desc->x + player_desc->radius, player_desc->y + player_desc->radius), player_entity_angle, player_entity_dist, tilemap);
+        // don't send entity if it is not visible by player
+        if (check_visibility && visibility_dist[c] < visibility_rays.range[c])
+            continue;
 
-            if (ray_dist < player_entity_dist)
-                continue;
-        }
+        if (frame.size() - size + EntityDesc::size() > max_size)
+            break;
 
-        if (desc.id != player->id)
-        {
-            desc.write(frame, false);
-            n++;
-        }
+        entities[candidates[c].second].write(frame, false);
+        n++;
     }
 
-    memcpy(n_addr, &n, sizeof(n));
+    memcpy(&frame.content()[n_offset], &n, sizeof(n));
 
     int n_despawned = (int)despawned_entities.size();
     frame.append(&n_despawned, sizeof(n_despawned));
@@ -71,6 +139,12 @@ const int Snapshot::write(NetworkFrame &frame, const Player *player, const Tilem
         frame.append(&id, sizeof(id));
     }
 
+    int n_events = (int)events.size();
+    frame.append(&n_events, sizeof(n_events));
+
+    for (const ProjectileEvent *event : events)
+        event->write(frame);
+
     frame.opcode() = OP_SNAPSHOT;
 
     return frame.size() - size;
@@ -78,7 +152,12 @@ const int Snapshot::write(NetworkFrame &frame, const Player *player, const Tilem
 
 const int Snapshot::size() const
 {
-    return 16 + EntityDesc::size() * (int)entities.size() + 4 * (int)despawned_entities.size();
+    int size = 24 + sizeof(tick_t) + ACK_SIZE + EntityDesc::size() * (int)entities.size() + 4 * (int)despawned_entities.size();
+    if (projectile_events)
+        for (const ProjectileEvent &event : *projectile_events)
+            size += event.size();
+    // write stops there
+    return size < MAX_SNAPSHOT_SIZE - HEADER_SIZE ? size : MAX_SNAPSHOT_SIZE - HEADER_SIZE;
 }
 
 const int WorldConfig::write(NetworkFrame &frame, const Player *player, const TilemapDesc *TilemapDesc) const
@@ -106,14 +185,36 @@ const int WorldConfig::size() const
     return size;
 }
 
+#define CONTROL_FRAME_MIN_SIZE (sizeof(tick_t) + sizeof(ID) + ACK_SIZE + CTRL_MSG_SIZE)
+#define REDUNDANT_CONTROL_SIZE (1 + CTRL_MSG_SIZE) // tick offset + control
+
+static void readControl(const char *buffer, Control &control)
+{
+    // first byte encodes movement + shoot command
+    uint8_t first_byte;
+    memcpy(&first_byte, &buffer[0], 1);
+
+    control.movement = first_byte >> 4;
+    control.change_weapon = (first_byte >> 2 & 3) > 0;
+    control.new_weapon_i = (first_byte >> 2 & 3) - 1;
+    control.run = (first_byte >> 1) % 2 == 1 ? true : false;
+    control.shoot = (first_byte % 2 == 1) ? true : false;
+
+    // next 4 bytes encode facing_angle as a float
+    memcpy(&control.facing_angle, &buffer[1], 4);
+}
+
 ControlFrame ControlFrame::read(NetworkFrame frame)
 {
     ControlFrame ctrl_frame;
     ctrl_frame.player_id = frame.sender;
 
-    ctrl_frame.reception_server_tick = Time::nowInTicks(CLIENT_PERIOD);
+    ctrl_frame.reception_server_tick = Time::frameTicks(CLIENT_PERIOD);
 
     const char *buffer = frame.content();
+    const int frame_size = (int)frame.size();
+    if (frame_size < (int)CONTROL_FRAME_MIN_SIZE)
+        return ctrl_frame;
 
     int size = 0;
 
@@ -129,19 +230,30 @@ ControlFrame ControlFrame::read(NetworkFrame frame)
     memcpy(&ctrl_frame.ack, &buffer[size], ACK_SIZE);
     size += ACK_SIZE;
 
-    // next byte encodes movement + shoot command
-    uint8_t first_byte;
-    memcpy(&first_byte, &buffer[size], 1);
-    size += 1;
+    // next CTRL_MSG_SIZE bytes contain the control of the frame
+    readControl(&buffer[size], ctrl_frame.control);
+    size += CTRL_MSG_SIZE;
+    ctrl_frame.valid = true;
 
-    ctrl_frame.control.movement = first_byte >> 4;
-    ctrl_frame.control.change_weapon = (first_byte >> 2 & 3) > 0;
-    ctrl_frame.control.new_weapon_i = (first_byte >> 2 & 3) - 1;
-    ctrl_frame.control.run = (first_byte >> 1) % 2 == 1 ? true : false;
-    ctrl_frame.control.shoot = (first_byte % 2 == 1) ? true : false;
+    // optional: number of earlier controls, then the controls
+    if (frame_size <= size)
+        return ctrl_frame;
 
-    // next 4 bytes encode facing_angle as a float
-    memcpy(&ctrl_frame.control.facing_angle, &buffer[size], 4);
+    uint8_t n_redundant;
+    memcpy(&n_redundant, &buffer[size], 1);
+    size += 1;
+
+    for (int i = 0; i < n_redundant && i < MAX_REDUNDANT_CONTROLS && size + REDUNDANT_CONTROL_SIZE <= frame_size; i++)
+    {
+        uint8_t offset;
+        memcpy(&offset, &buffer[size], 1);
+        size += 1;
+
+        Control &control = ctrl_frame.redundant[ctrl_frame.n_redundant++];
+        control.tick = ctrl_frame.control.tick - offset;
+        readControl(&buffer[size], control);
+        size += CTRL_MSG_SIZE;
+    }
 
     return ctrl_frame;
 }
@@ -154,19 +266,33 @@ ControlFrame ControlFrame::read(NetworkFrame frame)
 //
 //
 
-World::World(Map *map) : map(map) {}
+World::World(Map *map) : map(map), player_pool(MAX_PEERS), pathfinder(map->getTilemap()), perception(map->getTilemap())
+{
+    ai_scheduler.setPerception(&perception);
+    players.reserve(MAX_PEERS);
+    dropped_players.reserve(MAX_PEERS);
+    projectile_events.reserve(2 * MAX_PROJECTILES);
+    snapshot_events.reserve(2 * MAX_PROJECTILES);
+}
 
 World::~World()
 {
-    for (Player *player : players)
-        delete player;
+    // players belong to the pool, spawned NPCs to the spawner
     for (Entity *entity : entities)
-        delete entity;
+        if (!spawner || !spawner->owns(entity))
+            delete entity;
 }
 
 Player *World::createPlayer(ID id, sockaddr_in from, std::string name)
 {
-    Player *player = new Player(id, from, name);
+    Player *player = player_pool.acquire();
+    if (!player)
+    {
+        LOG_F(ERROR, "cannot create player %d, world is full (%d players)", id, getNPlayers());
+        return nullptr;
+    }
+
+    player->reset(id, from, name);
     player->place(map->spawn_points[0].elts[0].pos);
 
     LOG_F(INFO, "spawned player at %f, %f", player->pos.x, player->pos.y);
@@ -190,19 +316,62 @@ void World::dropPlayer(const ID id)
     // you'll be barely remembered ...
     players.erase(players.begin() + i);
     // BARELY !!!
-    delete player;
+    player_pool.release(player);
     // ARE YOU DEAD YET ?
 }
 
 void World::add(Entity *entity) { entities.push_back(entity); }
 void World::add(Player *player) { players.push_back(player); }
 
+void World::add(NPC *npc)
+{
+    entities.push_back(npc);
+    ai_scheduler.add(npc);
+}
+
+void World::remove(Entity *entity)
+{
+    ai_scheduler.remove(entity);
+
+    for (int i = 0; i < entities.size(); i++)
+        if (entities[i] == entity)
+        {
+            entities[i] = entities.back();
+            entities.pop_back();
+            dropped_players.push_back(entity->id);
+            return;
+        }
+}
+
+void World::setSpawner(std::unique_ptr<EntitySpawner> spawner) { this->spawner = std::move(spawner); }
+
 const int World::getNPlayers() const { return (int)players.size(); }
 
+InputMetrics World::collectInputMetrics()
+{
+    InputMetrics res = {};
+    for (Player *player : players)
+    {
+        InputMetrics metrics = player->collectInputMetrics();
+        res.released += metrics.released;
+        res.underruns += metrics.underruns;
+        res.late += metrics.late;
+        res.depth_sum += metrics.depth_sum;
+        if (metrics.max_depth > res.max_depth)
+            res.max_depth = metrics.max_depth;
+        res.resims += metrics.resims;
+        res.resim_ticks += metrics.resim_ticks;
+        res.resim_dropped += metrics.resim_dropped;
+    }
+    return res;
+}
+
 const std::vector<Player *> &World::getPlayers() const { return players; }
 
 const int World::getNEntities() const { return (int)entities.size(); }
 
+const int World::getNProjectiles() const { return projectiles.size(); }
+
 int World::getPlayerIndexById(const ID id) const
 {
     for (int i = 0; i < getNPlayers(); i++)
@@ -241,69 +410,159 @@ Entity *World::getById(const ID id, bool *is_player) const
 
 void World::update(tick_t current_tick)
 {
+    if (spawner)
+    {
+        TraceZone zone("spawner");
+        spawner->update(current_tick);
+    }
+
+    {
+        TraceZone zone("pathfinder");
+        pathfinder.update(players);
+    }
+    {
+        TraceZone zone("perception");
+        perception.update(players);
+    }
+    {
+        TraceZone zone("ai");
+        ai_scheduler.update(current_tick, players);
+    }
+
+    {
+        TraceZone zone("shoot");
+        for (Player *player : players)
+            if (player->want_shoot && player->canShoot(current_tick))
+                shoot(player, player->client_tick, current_tick);
+        // NPCs see the present, no lag compensation
+        for (Entity *entity : entities)
+            if (entity->want_shoot && entity->canShoot(current_tick))
+                shoot(entity, current_tick, current_tick);
+    }
+
+    // players whose late controls changed their past, within the budget
+    int resim_budget = MAX_RESIM_TICKS;
     for (Player *player : players)
-        if (player->want_shoot && player->canShoot(current_tick))
-        {
-            for (int i = 0; i < player->equipped_weapon.bullet_count; i++)
-            {
-                Bullet bullet;
-                player->configBullet(&bullet);
-                doHitScan(bullet, player->client_tick);
-            }
-            player->registerShoot(current_tick);
-        }
+        resim_budget -= player->resimulate(map->getTilemap(), resim_budget);
 
-    for (Player *entity : players)
-        entity->update(current_tick, map->getTilemap());
-    for (Entity *entity : entities)
-        entity->update(current_tick, map->getTilemap());
+    {
+        TraceZone zone("move");
+        ControlList ctrls; // reused by every entity, nothing to allocate
+        for (Player *entity : players)
+            entity->update(current_tick, map->getTilemap(), ctrls);
+        for (Entity *entity : entities)
+            entity->update(current_tick, map->getTilemap(), ctrls);
+    }
+
+    if (projectiles.size() > 0)
+    {
+        TraceZone zone("projectiles");
+        projectile_targets.clear();
+        projectile_targets.insert(projectile_targets.end(), players.begin(), players.end());
+        projectile_targets.insert(projectile_targets.end(), entities.begin(), entities.end());
+        projectiles.update(projectile_targets, map->getTilemap(), projectile_events);
+    }
 }
 
-void World::doHitScan(Bullet bullet, tick_t tick)
+void World::shoot(Entity *shooter, tick_t seen_tick, tick_t current_tick)
 {
-    const Snapshot *snapshot = getSnapshotAtTick(tick);
-    if (snapshot == nullptr)
+    bullets.clear();
+    for (int i = 0; i < shooter->equipped_weapon.bullet_count; i++)
     {
-        LOG_F(ERROR, "could not find snapshot at tick %d", tick);
-        return;
+        Bullet bullet;
+        shooter->configBullet(&bullet);
+        bullets.push_back(bullet);
     }
 
-    float closest_dist = -1;
-    const EntityDesc *closest_entity = nullptr;
+    // bullet_speed 0 means hitscan
+    if (shooter->equipped_weapon.bullet_speed > 0)
+        for (const Bullet &bullet : bullets)
+            projectiles.spawn(bullet, shooter->equipped_weapon.bullet_speed, projectile_events);
+    else
+        doHitScan(bullets, seen_tick);
 
-    for (int i = 0; i < snapshot->entities.size(); i++)
-    {
-        const EntityDesc *entity = &snapshot->entities[i];
-        if (entity->id == bullet.owner)
-            continue;
+    shooter->registerShoot(current_tick);
+}
 
-        float dist = computeDistance(bullet.pos, bullet.angle, Vec2f(entity->x + entity->radius, entity->y + entity->radius), entity->radius);
+void World::doHitScan(const std::vector<Bullet> &bullets, tick_t tick)
+{
+    int n = (int)bullets.size();
+    if (n <= 0)
+        return;
 
-        if (dist > 0 && dist <= bullet.range)
+    // the entities where the shooter saw them, or where they are now when
+    // nothing was remembered yet (no snapshot was made before this tick)
+    hitscan_circles.clear();
+    hitscan_ids.clear();
+    const Snapshot *snapshot = getSnapshotAtTick(tick);
+    if (snapshot)
+    {
+        for (const EntityDesc &entity : snapshot->entities)
+        {
+            hitscan_circles.push(Vec2f(entity.x + entity.radius, entity.y + entity.radius), entity.radius);
+            hitscan_ids.push_back(entity.id);
+        }
+    }
+    else
+    {
+        for (Player *player : players)
+        {
+            hitscan_circles.push(player->pos + Vec2f(player->radius, player->radius), player->radius);
+            hitscan_ids.push_back(player->id);
+        }
+        for (Entity *entity : entities)
         {
-            if (closest_dist < 0 || dist < closest_dist)
+            hitscan_circles.push(entity->pos + Vec2f(entity->radius, entity->radius), entity->radius);
+            hitscan_ids.push_back(entity->id);
+        }
+    }
+
+    hitscan_rays.clear();
+    for (const Bullet &bullet : bullets)
+    {
+        // all the bullets of a shot share the same owner, but don't assume it
+        int skip = -1;
+        for (int i = 0; i < (int)hitscan_ids.size(); i++)
+            if (hitscan_ids[i] == bullet.owner)
             {
-                closest_dist = dist;
-                closest_entity = entity;
+                skip = i;
+                break;
             }
-        }
+
+        hitscan_rays.push(bullet.pos, bullet.dir, (float)bullet.range, skip);
     }
 
-    float wall_dist = computeDistance(bullet.pos, bullet.angle, (float)bullet.range, map->getTilemap());
+    hitscan_dist.resize(n);
+    hitscan_index.resize(n);
+    computeClosestHits(hitscan_rays, hitscan_circles, hitscan_dist.data(), hitscan_index.data());
 
-    if (closest_dist < 0 || wall_dist < closest_dist)
-        return;
+    hitscan_wall_dist.resize(n);
+    computeDistances(hitscan_rays, map->getTilemap(), hitscan_wall_dist.data());
 
-    bool is_player = false;
-    Entity *target = getById(closest_entity->id, &is_player);
-    if (target)
+    for (int i = 0; i < n; i++)
     {
-        target->hurt(bullet.damage);
+        float closest_dist = hitscan_dist[i];
+        if (closest_dist < 0)
+            continue;
+
+        const Bullet &bullet = bullets[i];
+        if (hitscan_wall_dist[i] < closest_dist)
+            continue;
+
+        bool is_player = false;
+        Entity *target = getById(hitscan_ids[hitscan_index[i]], &is_player);
+        if (target)
+        {
+            target->hurt(bullet.damage);
+        }
     }
 }
 
 const Snapshot *World::getSnapshotAtTick(tick_t tick) const
 {
+    if (snapshot_history.empty())
+        return nullptr;
+
     for (int i = 0; i < snapshot_history.size(); i++)
     {
         if (snapshot_history[i].tick <= tick)
@@ -333,6 +592,11 @@ Snapshot World::makeSnapshot(tick_t current_tick)
         for (int i = 0; i < dropped_players.size(); i++)
             res.despawned_entities.push_back(dropped_players[i]);
         dropped_players.clear();
+
+        // no copy, the two buffers take turns
+        std::swap(snapshot_events, projectile_events);
+        projectile_events.clear();
+        res.projectile_events = &snapshot_events;
     }
 
     return res;
@@ -340,8 +604,11 @@ Snapshot World::makeSnapshot(tick_t current_tick)
 
 void World::remember(Snapshot snapshot)
 {
+    // kept to rewind hitscans, its events are only sent once
+    snapshot.projectile_events = nullptr;
     snapshot_history.push_front(snapshot);
 
-    while (snapshot_history.back().tick < Time::nowInTicks(CLIENT_PERIOD) - MAX_PING / CLIENT_PERIOD)
+    tick_t now = Time::frameTicks(CLIENT_PERIOD);
+    while (snapshot_history.back().tick < now - MAX_PING / CLIENT_PERIOD)
         snapshot_history.pop_back();
 }
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include <filesystem>
+#include "loguru/loguru.hpp"
+
+#include "engine/cooked_map.h"
+#include "engine/tilemap.h"
+
+namespace fs = std::filesystem;
+
+// Cooks a Tiled map into the binary format mapped by the server at startup:
+//   mapcook map.xml [out.cmap] [--scale N]
+// the output defaults to the input path with a .cmap extension, the scale
+// must be the one of the server (4)
+int main(int argc, char **argv)
+{
+    loguru::init(argc, argv);
+
+    const char *in_path = nullptr;
+    std::string out_path;
+    int scale = 4;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+            scale = atoi(argv[++i]);
+        else if (!in_path)
+            in_path = argv[i];
+        else
+            out_path = argv[i];
+    }
+
+    if (!in_path)
+    {
+        LOG_F(ERROR, "usage: %s map.xml [out" COOKED_MAP_EXTENSION "] [--scale N]", argv[0]);
+        return 1;
+    }
+    if (out_path.empty())
+        out_path = fs::path(in_path).replace_extension(COOKED_MAP_EXTENSION).string();
+
+    Map map(scale);
+    if (!map.load(in_path))
+    {
+        LOG_F(ERROR, "could not load map %s", in_path);
+        return 1;
+    }
+
+    return map.cook(out_path.c_str()) ? 0 : 1;
+}
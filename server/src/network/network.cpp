@@ -54,6 +54,8 @@ int UDPServer::_send(const char *buffer, int buffer_size, const sockaddr_in *to)
 
 int UDPServer::sendTo(ID id, const NetworkFrame &frame)
 {
+    std::lock_guard<std::recursive_mutex> lock(peers_mutex);
+
     if (!isAlive(id))
     {
         LOG_F(ERROR, "cannot send to dead peer %d", id);
@@ -95,23 +97,26 @@ int UDPServer::_receive(char *buffer, int buffer_size, sockaddr_in *from)
     return bytes_received;
 }
 
-int UDPServer::update(unsigned long long timeout)
+int UDPServer::update(Duration timeout)
 {
     // drop dead clients
+    std::unique_lock<std::recursive_mutex> lock(peers_mutex);
+    unsigned long long now = Time::nowInMilliseconds();
     for (int i = 0; i < MAX_PEERS; i++)
     {
-        if (alive[i] &&
-            Time::nowInMilliseconds() > last_com_date[i] + SERVER_TIMEOUT)
+        if (alive[i] && now > last_com_date[i] + SERVER_TIMEOUT)
         {
             LOG_F(ERROR, "no frame from peer %d at %s:%hu for %d ms, dropping peer",
                   peers[i].id,
                   inet_ntoa(peers[i].addr.sin_addr), ntohs(peers[i].addr.sin_port),
-                  Time::nowInMilliseconds() - last_com_date[i]);
+                  now - last_com_date[i]);
             kill(peers[i].id);
         }
     }
 
-    struct timeval tv = Time::timevalOfLongLong(timeout);
+    lock.unlock();
+
+    struct timeval tv = Time::timevalOfDuration(timeout);
 
     FD_SET read_set;
     FD_ZERO(&read_set);
@@ -121,6 +126,8 @@ int UDPServer::update(unsigned long long timeout)
 
     if (ret > 0)
     {
+        lock.lock();
+
         char buffer[BUFFER_SIZE];
         sockaddr_in from;
         int received = _receive(buffer, BUFFER_SIZE, &from);
@@ -189,6 +196,8 @@ int UDPServer::update(unsigned long long timeout)
 
 int UDPServer::getAvailableSlot() const
 {
+    std::lock_guard<std::recursive_mutex> lock(peers_mutex);
+
     for (int i = 0; i < MAX_PEERS; i++)
         if (!alive[i])
             return i;
@@ -197,6 +206,8 @@ int UDPServer::getAvailableSlot() const
 
 Peer *UDPServer::setSlot(int i, ID id, const sockaddr_in *addr)
 {
+    std::lock_guard<std::recursive_mutex> lock(peers_mutex);
+
     if (alive[i])
     {
         LOG_F(ERROR, "attempt to overwrite living peer %d by peer %d (ignored)", peers[i].id, id);
@@ -233,6 +244,8 @@ int UDPServer::getPeerSlotByAddr(const sockaddr_in *addr) const
 
 bool UDPServer::isAlive(const ID id) const
 {
+    std::lock_guard<std::recursive_mutex> lock(peers_mutex);
+
     int i = getPeerSlotByID(id);
     if (i < 0)
         return false;
@@ -241,6 +254,8 @@ bool UDPServer::isAlive(const ID id) const
 
 void UDPServer::kill(const ID id)
 {
+    std::lock_guard<std::recursive_mutex> lock(peers_mutex);
+
     int i = getPeerSlotByID(id);
     if (i >= 0)
     {
@@ -253,6 +268,8 @@ void UDPServer::kill(const ID id)
 
 bool UDPServer::getAddr(const ID id, sockaddr_in *addr) const
 {
+    std::lock_guard<std::recursive_mutex> lock(peers_mutex);
+
     int i = getPeerSlotByID(id);
     if (i >= 0)
     {
@@ -320,6 +337,8 @@ void UDPServer::sendServerInit(const ID id)
 
 std::vector<ID> UDPServer::lostConnections()
 {
+    std::lock_guard<std::recursive_mutex> lock(peers_mutex);
+
     if (lost_connections.size() <= 0)
         return std::vector<ID>();
 
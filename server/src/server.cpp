@@ -1,9 +1,15 @@
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <memory>
 #include "loguru/loguru.hpp"
 
 #include "common/deftypes.h"
 #include "common/time.h"
+#include "common/profiler.h"
+#include "common/scheduler.h"
+#include "common/trace.h"
 #include "common/vector.hpp"
 #include "common/utils.h"
 #include "network/portfinder.h"
@@ -15,18 +21,96 @@
 #include "engine/world.h"
 #include "engine/controller.h"
 #include "engine/ai.h"
+#include "engine/behavior.h"
+#include "engine/match.h"
+#include "engine/spawner.h"
 
 #define PERIOD 1000.0 / 60.0 // 60 frame per sec, in msec
 
 namespace fs = std::filesystem;
 
-void handleFrame(const NetworkFrame &frame);
+// phases of an iteration of the network loop
+enum ServerPhase
+{
+    SERVER_PHASE_RECEIVE,  // network.update, waiting for frames included
+    SERVER_PHASE_LOST,     // lost connections
+    SERVER_PHASE_DISPATCH, // frames routed to the matches
+    SERVER_PHASE_TCP,      // file loaders
+    N_SERVER_PHASES
+};
+
+static const char *const SERVER_PHASE_NAMES[N_SERVER_PHASES] = {"receive", "lost", "dispatch", "tcp"};
+
+// set by the trace signal, the network loop starts the capture
+static volatile sig_atomic_t trace_requested = 0;
+
+static void requestTrace(int)
+{
+    trace_requested = 1;
+}
+
+static void logMetrics(MatchManager &matches, Profiler &profiler)
+{
+    PhaseStats phases[N_SERVER_PHASES];
+    profiler.collect(phases);
+    logPhases("Network", SERVER_PHASE_NAMES, phases, N_SERVER_PHASES);
+
+    for (const MatchMetrics &metrics : matches.collectMetrics())
+    {
+        LOG_F(INFO, "Match %d, n_players:%d, n_entities:%d, ticks:%d (%d wakeups), wakeup time mean:%.3fms max:%.3fms, missed server ticks:%d, dropped ticks:%d, AI thinks:%d postponed:%d over budget:%d max:%dus, inputs:%d underruns:%d late:%d depth mean:%.1f max:%d, resims:%d (%d ticks, %d too old), jitter p50:%lluus p99:%lluus max:%lluus",
+              metrics.match_id, metrics.n_players, metrics.n_entities, metrics.n_ticks, metrics.n_wakeups,
+              metrics.mean_tick_ms, metrics.max_tick_ms, metrics.missed_server_ticks, metrics.dropped_ticks,
+              metrics.ai_thinks, metrics.ai_postponed, metrics.ai_over_budget, metrics.ai_max_think_us,
+              metrics.input.released, metrics.input.underruns, metrics.input.late,
+              metrics.n_ticks * metrics.n_players > 0 ? (float)metrics.input.depth_sum / (metrics.n_ticks * metrics.n_players) : 0.0f, metrics.input.max_depth,
+              metrics.input.resims, metrics.input.resim_ticks, metrics.input.resim_dropped,
+              metrics.jitter_p50 / 1000, metrics.jitter_p99 / 1000, metrics.jitter_max / 1000);
+        std::string prefix = "Match " + std::to_string(metrics.match_id);
+        logPhases(prefix.c_str(), MATCH_PHASE_NAMES, metrics.phases, N_MATCH_PHASES);
+    }
+}
 
 int main(int argc, char **argv)
 {
     loguru::init(argc, argv);
     Time::startNow();
 
+    // --matches N: number of independent worlds
+    // --cpu N: pin match threads to cores N, N+1, ...
+    // --map path: tiled map to load
+    // --ai-threads N: threads helping each match with its AIs
+    // --trace-ticks N: client ticks captured by a trace (SIGUSR1, Ctrl+Break on Windows)
+    int n_matches = 1;
+    int first_cpu = -1;
+    int ai_threads = 0;
+    int trace_ticks = 300;
+    const char *map_path = "data/second_try.xml";
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--matches") == 0)
+        {
+            n_matches = atoi(argv[++i]);
+            if (n_matches < 1)
+                n_matches = 1;
+        }
+        else if (strcmp(argv[i], "--cpu") == 0)
+            first_cpu = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--map") == 0)
+            map_path = argv[++i];
+        else if (strcmp(argv[i], "--ai-threads") == 0)
+        {
+            ai_threads = atoi(argv[++i]);
+            if (ai_threads < 0)
+                ai_threads = 0;
+        }
+        else if (strcmp(argv[i], "--trace-ticks") == 0)
+        {
+            trace_ticks = atoi(argv[++i]);
+            if (trace_ticks < 1)
+                trace_ticks = 1;
+        }
+    }
+
     int errcode;
 
     WSADATA wsaData;
@@ -49,7 +133,12 @@ int main(int argc, char **argv)
 
     // make map
     Map map(4);
-    map.load("data/second_try.xml");
+    if (!map.load(map_path))
+    {
+        LOG_F(ERROR, "could not load map %s", map_path);
+        WSACleanup();
+        return 1;
+    }
 
     NetworkFrame tilemap_frame(map.getTilemap()->size());
     tilemap_frame.opcode() = OP_BINARY;
@@ -67,6 +156,11 @@ int main(int argc, char **argv)
     weapons_frame.opcode() = OP_BINARY;
     Weapons::write(weapons_frame);
 
+    // enemy behaviors, compiled once and shared by all matches
+
+    Behaviors::loadFromFile("data/behaviors.xml");
+    LOG_F(INFO, "Loaded %d behaviors", Behaviors::nBehaviors());
+
     // prepare files to be sent by TCP servers
 
     std::vector<NetworkFrame *> files;
@@ -74,79 +168,86 @@ int main(int argc, char **argv)
     files.push_back(&tileset_frame);
     files.push_back(&weapons_frame);
 
-    // make world
-    World world(&map);
+    // make matches, they all share the map and the UDP server
+    MatchManager matches(&network);
+    matches.create(n_matches, &map, first_cpu);
 
-    // create AI players
-    std::shared_ptr<LinePath> ai = std::make_shared<LinePath>(&world, 200.0);
-
-    AIController *controller = new AIController(ai);
-    Entity other_player(freshID(), CONTROLLED_ENTITY, "Phasko", 100, controller);
-    other_player.type = PLAYER;
-    other_player.move(Vec2f(100, 100));
-    world.add(&other_player);
-
-    AIController *controller_ = new AIController(ai);
-    Entity other_player_(freshID(), CONTROLLED_ENTITY, "Mr. le Bref", 100, controller_);
-    other_player_.type = PLAYER;
-    other_player_.move(Vec2f(200, 400));
-    world.add(&other_player_);
+    // AI entities come from the enemy groups of the map, they chase players
+    // unless they have a behavior
+    for (int i = 0; i < matches.size(); i++)
+    {
+        World *world = matches.get(i)->getWorld();
+        std::unique_ptr<EntitySpawner> spawner = std::make_unique<EntitySpawner>(world, &map, std::make_shared<Chase>(world));
+        for (int b = 0; b < Behaviors::nBehaviors(); b++)
+        {
+            const BehaviorTree *tree = Behaviors::get(b);
+            spawner->setAI(tree->name, std::make_shared<BehaviorAI>(world, tree));
+        }
+        world->setSpawner(std::move(spawner));
+        world->getAIScheduler()->setNThreads(ai_threads);
+    }
 
-    // initial snapshot
-    Snapshot snapshot = world.makeSnapshot(0);
-    world.remember(snapshot);
+    matches.start();
 
-    tick_t last_server_tick = Time::nowInTicks(SERVER_PERIOD);
-    tick_t last_client_tick = Time::nowInTicks(CLIENT_PERIOD);
+    // the network loop waits for frames until the next client tick, and
+    // updates the TCP servers once per client tick
+    TickScheduler ticks(CLIENT_PERIOD, 1);
 
-    std::vector<ID> new_connections;
     std::vector<TCPServer *> file_loaders;
 
     unsigned long long infrequent_log_deadline = 0;
+    Profiler profiler(SERVER_PHASE_NAMES, N_SERVER_PHASES);
+
+    Trace::setThreadName("network");
+#if defined(SIGUSR1)
+    signal(SIGUSR1, requestTrace);
+#elif defined(SIGBREAK)
+    signal(SIGBREAK, requestTrace);
+#endif
 
     while (network.isOpen())
     {
-        tick_t server_tick = Time::nowInTicks(SERVER_PERIOD);
-        tick_t client_tick = Time::nowInTicks(CLIENT_PERIOD);
+        Time::publishFrameTime();
 
-        if (Time::nowInMilliseconds() > infrequent_log_deadline)
+        if ((unsigned long long)Time::frameTime().ns / 1000000 > infrequent_log_deadline)
         {
-            LOG_F(INFO, "Tick %d, n_players:%d, n_entities:%d", Time::nowInTicks(CLIENT_PERIOD), world.getNPlayers(), world.getNEntities());
+            logMetrics(matches, profiler);
             infrequent_log_deadline = Time::nextDeadline(600 * SERVER_PERIOD);
         }
 
-        // read messages, update lost connections
-        // return in less than timeout ms
-        unsigned long long timeout = Time::timeBeforeDeadline(CLIENT_PERIOD) / 2;
-        if (timeout > 0)
-            network.update(timeout);
+        if (trace_requested)
+        {
+            trace_requested = 0;
+            std::string path = "trace_" + std::to_string(Time::now()) + ".json";
+            if (Trace::isCapturing())
+                LOG_F(WARNING, "trace requested while another one is running (ignored)");
+            else
+                Trace::capture(path.c_str(), Duration::nanoseconds((int64_t)(trace_ticks * CLIENT_PERIOD * 1e9)));
+        }
+
+        // read messages, update lost connections, returns by the next
+        // client tick at the latest
+        {
+            ScopedTimer timer(profiler, SERVER_PHASE_RECEIVE);
+            network.update(ticks.timeBeforeNextTick());
+        }
 
         // drop dead players
-        for (auto player_id : network.lostConnections())
-            world.dropPlayer(player_id);
+        {
+            ScopedTimer timer(profiler, SERVER_PHASE_LOST);
+            for (auto player_id : network.lostConnections())
+                matches.dropPeer(player_id);
+        }
 
-        // update players
+        // static info is the same for every match, everything else is
+        // handled by the match of the sender
+        ScopedTimer dispatch_timer(profiler, SERVER_PHASE_DISPATCH);
+        matches.update();
         while (!network.empty())
         {
             NetworkFrame frame = network.pop();
 
-            // handle incoming frame
-            switch (frame.opcode())
-            {
-            case OP_CONTROL_FRAME:
-            {
-                Player *player = world.getPlayerById(frame.sender);
-                if (!player)
-                {
-                    LOG_F(ERROR, "cannot find player with id %d", frame.sender);
-                    continue;
-                }
-
-                ControlFrame ctrl_frame = ControlFrame::read(frame);
-                player->rememberControl(ctrl_frame.control);
-                break;
-            }
-            case OP_STATIC_INFO:
+            if (frame.opcode() == OP_STATIC_INFO)
             {
                 LOG_F(INFO, "launching TCP server");
                 TCPServer *tcp_server;
@@ -167,60 +268,17 @@ int main(int argc, char **argv)
                 new_frame.appendInt32(port);
                 new_frame.opcode() = OP_STATIC_INFO;
                 network.sendTo(frame.sender, new_frame);
-                break;
-            }
-            case OP_CONFIG:
-            {
-                sockaddr_in player_addr;
-                if (!network.getAddr(frame.sender, &player_addr))
-                {
-                    LOG_F(ERROR, "unknown player %d at %s:%hu asking for world (ignored)",
-                          frame.sender, inet_ntoa(player_addr.sin_addr), ntohs(player_addr.sin_port));
-                    continue;
-                }
-
-                // make sure the name is not too long and
-                // that the string is null terminated
-                char *player_name = frame.content();
-                if (frame.size() <= NAME_SIZE)
-                    player_name[frame.size()] = '\0';
-                else
-                {
-                    NetworkFrame frame;
-                    frame.opcode() = OP_WRONG_CONFIG;
-                    network.sendTo(frame.sender, frame);
-                    continue;
-                }
-
-                Player *player = world.createPlayer(frame.sender, player_addr, player_name);
-                LOG_F(INFO, "created new player %s with ID %d", player->name, player->id);
-                new_connections.push_back(player->id);
-                break;
-            }
-            case OP_CLIENT_READY:
-            {
-                Player *player = world.getPlayerById(frame.sender);
-                if (!player)
-                {
-                    LOG_F(ERROR, "unknown player %d is ready (ignored)",
-                          frame.sender);
-                    continue;
-                }
-                player->ready = true;
-                break;
-            }
-            default:
-                LOG_F(WARNING, "[tick:%d] Got unexpected frame while waiting for CONTROL_FRAME: opcode:%hu size:%hu (dropped)", Time::nowInTicks(CLIENT_PERIOD), frame.opcode(), frame.size());
             }
+            else if (!matches.route(frame))
+                LOG_F(WARNING, "[tick:%d] Got frame from peer %d outside of any match: opcode:%hu size:%hu (dropped)", Time::nowInTicks(CLIENT_PERIOD), frame.sender, frame.opcode(), frame.size());
         }
+        dispatch_timer.stop();
 
-        // do frequent stuff:
-        // read and process incoming control frames from players
         // send new packets from tcp servers
-        if (client_tick > last_client_tick)
+        tick_t client_tick;
+        if (ticks.poll(&client_tick) > 0)
         {
-            world.update(client_tick);
-
+            ScopedTimer timer(profiler, SERVER_PHASE_TCP);
             for (int i = 0; i < file_loaders.size(); i++)
                 if (file_loaders[i]->update(1))
                 {
@@ -230,61 +288,13 @@ int main(int argc, char **argv)
                     file_loaders.erase(file_loaders.begin() + i);
                     i--;
                 }
-
-            last_client_tick = client_tick;
-        }
-
-        // do less frequent stuff
-        // send snapshot to players and world configs to new players
-        if (server_tick > last_server_tick)
-        {
-            if (server_tick > last_server_tick + 1)
-                LOG_F(WARNING, "Missed server ticks (%d -> %d)", last_server_tick, server_tick);
-
-            // produce snapshot for current tick
-            Snapshot snapshot = world.makeSnapshot(client_tick);
-            world.remember(snapshot);
-
-            if (new_connections.size() > 0)
-            {
-                WorldConfig config;
-                config.client_rate = CLIENT_RATE;
-                config.server_rate = SERVER_RATE;
-                config.ack_size = ACK_SIZE;
-                config.initial_snapshot = &snapshot;
-
-                for (ID id : new_connections)
-                {
-                    Player *player = world.getPlayerById(id);
-                    if (!player)
-                    {
-                        LOG_F(ERROR, "player %d disconnected before I could send world config :(", id);
-                        continue;
-                    }
-
-                    NetworkFrame frame(config.size());
-                    config.write(frame, player, map.getTilemap());
-                    network.sendTo(id, frame);
-
-                    LOG_F(INFO, "sent %d bytes to player %d, initial tick %d", frame.size(), id, config.initial_snapshot->tick);
-                }
-                new_connections.clear();
-            }
-
-            for (Player *player : world.getPlayers())
-            {
-                if (player->ready && network.isAlive(player->id))
-                {
-                    NetworkFrame frame(snapshot.size());
-                    snapshot.write(frame, player, map.getTilemap());
-                    network.sendTo(player->id, frame);
-                }
-            }
-
-            last_server_tick = server_tick;
         }
     }
 
+    matches.stop();
+    logMetrics(matches, profiler);
+    Trace::stop();
+
     network.close();
     WSACleanup();
 